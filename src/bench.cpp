@@ -0,0 +1,546 @@
+/**
+ * @brief benchmark program
+ * Compares the search modes of Router, including contraction hierarchy queries, on a map.
+ * For each mode it runs the same seeded random node pairs and reports the
+ * average number of settled nodes and the average time per query.
+ * It also times snapping random coordinates to their nearest routable node,
+ * and isochrone searches from the pair sources with half the average route cost as budget.
+ * Arcs are weighted by the given profile, distance by default.
+ *
+ * With --stages it instead times the stages of the main program separately, Osm
+ * construction, computeRoute with and without route cache hits, Image construction,
+ * drawRoute and saveImage, on both test maps and on a generated grid. Every run uses
+ * the same seed and the same grid, and the results are written as JSON with
+ * percentiles and peak RSS so that runs can be compared against a saved baseline.
+ * Each map is run in its own forked process, so its peak RSS is its own.
+ *
+ * With --tiles it renders the Web Mercator tiles of a map for a range of zoom
+ * levels, into a z/x/y.pgm directory or, for a name ending in .tiles, into one
+ * archive. It reports the tile count and time, and for an archive reads back
+ * the tile holding the middle of the map at the deepest level.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "osm.hpp"
+#include "image.hpp"
+#include "spatialindex.hpp"
+#include "threadpool.hpp"
+#include "tilerenderer.hpp"
+
+namespace {
+    const unsigned SEED = 42;
+
+    // Timings of one stage, in milliseconds
+    struct Stage {
+        std::string name;
+        std::vector<double> samples;
+    };
+
+    /** \brief  Returns the sample below which the given share
+     *          of the sorted samples fall, by nearest rank.
+     *
+     *          @return double
+    */
+    double percentile(const std::vector<double> &sorted, double share)
+    {
+        size_t rank = static_cast<size_t>(share * sorted.size() + 0.999999);
+        return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+    }
+
+    /** \brief  Returns the largest resident set size so far, in
+     *          kilobytes, of this process for RUSAGE_SELF or of
+     *          the largest waited for child for RUSAGE_CHILDREN.
+     *
+     *          @return long
+    */
+    long peakRssKb(int who = RUSAGE_SELF)
+    {
+        struct rusage usage;
+        return (getrusage(who, &usage) == 0) ? usage.ru_maxrss : 0;
+    }
+
+    double millisSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /** \brief  Writes an .osm file of side by side nodes on a
+     *          square grid, joined by one residential way per row
+     *          and column, with every fifth row and column a
+     *          primary road. The same side always gives the same
+     *          file.
+     *
+     *          @return bool false if the file could not be written
+    */
+    bool writeGrid(const std::string &path, unsigned side)
+    {
+        const double SPACING = 0.0005;
+        std::ofstream out(path);
+        out << std::fixed << std::setprecision(7);
+        out << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<osm version=\"0.6\" generator=\"bench\">\n";
+        out << " <bounds minlat=\"30\" minlon=\"-84\" maxlat=\"" << 30 + SPACING * (side - 1)
+            << "\" maxlon=\"" << -84 + SPACING * (side - 1) << "\"/>\n";
+        for (unsigned r = 0; r < side; r++)
+        {
+            for (unsigned c = 0; c < side; c++)
+            {
+                out << " <node id=\"" << r * side + c + 1 << "\" lat=\"" << 30 + SPACING * r
+                    << "\" lon=\"" << -84 + SPACING * c << "\"/>\n";
+            }
+        }
+        unsigned long wayId = 1;
+        for (int vertical = 0; vertical < 2; vertical++)
+        {
+            for (unsigned line = 0; line < side; line++)
+            {
+                out << " <way id=\"" << wayId++ << "\">\n";
+                for (unsigned k = 0; k < side; k++)
+                {
+                    unsigned node = vertical ? k * side + line : line * side + k;
+                    out << "  <nd ref=\"" << node + 1 << "\"/>\n";
+                }
+                out << "  <tag k=\"highway\" v=\"" << (line % 5 == 0 ? "primary" : "residential") << "\"/>\n";
+                out << " </way>\n";
+            }
+        }
+        out << "</osm>\n";
+        return static_cast<bool>(out);
+    }
+
+    /** \brief  Times every stage of loading, routing and
+     *          drawing one map and appends its JSON object to
+     *          json.
+     *
+     *          @return bool false if the map has no routable nodes
+    */
+    bool benchMap(const std::string &name, const std::string &path, unsigned numPairs, unsigned repeats,
+                  unsigned side, std::ostream &json)
+    {
+        Stage construct = { "osm_construct", {} };
+        for (unsigned i = 0; i < repeats; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Osm timed(path);
+            construct.samples.push_back(millisSince(start));
+        }
+        Osm osm(path);
+        std::shared_ptr<const Graph> graph = osm.getGraph();
+        std::vector<std::string> routable;
+        for (NodeView node : NodeRange(graph))
+        {
+            if (graph->isRoutable(node.index()))
+            {
+                routable.push_back(std::to_string(node.id()));
+            }
+        }
+        if (routable.empty())
+        {
+            std::cerr << "no routable nodes in " << path << std::endl;
+            return false;
+        }
+        std::mt19937 rng(SEED);
+        std::uniform_int_distribution<size_t> pick(0, routable.size() - 1);
+        Stage route = { "compute_route", {} };
+        std::vector<std::vector<OsmNode>> routes;
+        std::vector<std::pair<std::string, std::string>> pairs;
+        for (unsigned i = 0; i < numPairs; i++)
+        {
+            pairs.push_back(std::make_pair(routable[pick(rng)], routable[pick(rng)]));
+            auto start = std::chrono::steady_clock::now();
+            routes.push_back(osm.computeRoute(pairs.back().first, pairs.back().second));
+            route.samples.push_back(millisSince(start));
+        }
+        //The same pairs again, now answered by the route cache
+        Stage cachedRoute = { "compute_route_cached", {} };
+        for (const std::pair<std::string, std::string> &p : pairs)
+        {
+            auto start = std::chrono::steady_clock::now();
+            osm.computeRoute(p.first, p.second);
+            cachedRoute.samples.push_back(millisSince(start));
+        }
+        //Every image draws on the same workers, so no sample pays for starting threads
+        Stage image = { "image_construct", {} };
+        ThreadPool drawPool;
+        for (unsigned i = 1; i < repeats; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            Image timed(osm, side, side, Projection::EQUIRECTANGULAR, &drawPool);
+            image.samples.push_back(millisSince(start));
+        }
+        auto imageStart = std::chrono::steady_clock::now();
+        Image img(osm, side, side, Projection::EQUIRECTANGULAR, &drawPool);
+        image.samples.push_back(millisSince(imageStart));
+        Stage draw = { "draw_route", {} };
+        for (const std::vector<OsmNode> &r : routes)
+        {
+            auto start = std::chrono::steady_clock::now();
+            img.drawRoute(r);
+            draw.samples.push_back(millisSince(start));
+        }
+        Stage saveBinary = { "save_image_binary", {} };
+        Stage saveAscii = { "save_image_ascii", {} };
+        std::string imagePath = "/tmp/bench_" + name + ".pgm";
+        for (unsigned i = 0; i < repeats; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            img.saveImage(imagePath, Image::PGM_BINARY);
+            saveBinary.samples.push_back(millisSince(start));
+            start = std::chrono::steady_clock::now();
+            img.saveImage(imagePath, Image::PGM_ASCII);
+            saveAscii.samples.push_back(millisSince(start));
+        }
+        std::remove(imagePath.c_str());
+
+        const Stage *stages[] = { &construct, &route, &cachedRoute, &image, &draw, &saveBinary, &saveAscii };
+        json << "    {\n      \"name\": \"" << name << "\",\n      \"path\": \"" << path << "\",\n"
+             << "      \"nodes\": " << graph->size() << ",\n      \"arcs\": " << graph->arcCount()
+             << ",\n      \"canvas\": " << side << ",\n      \"peak_rss_kb\": " << peakRssKb()
+             << ",\n      \"stages\": {\n";
+        for (size_t s = 0; s < sizeof(stages) / sizeof(stages[0]); s++)
+        {
+            std::vector<double> sorted = stages[s]->samples;
+            std::sort(sorted.begin(), sorted.end());
+            double total = 0;
+            for (double ms : sorted)
+            {
+                total += ms;
+            }
+            json << "        \"" << stages[s]->name << "\": { \"samples\": " << sorted.size();
+            if (!sorted.empty())
+            {
+                json << ", \"mean_ms\": " << total / sorted.size() << ", \"min_ms\": " << sorted.front()
+                     << ", \"p50_ms\": " << percentile(sorted, 0.5) << ", \"p90_ms\": " << percentile(sorted, 0.9)
+                     << ", \"p99_ms\": " << percentile(sorted, 0.99) << ", \"max_ms\": " << sorted.back();
+            }
+            json << " }" << (s + 1 < sizeof(stages) / sizeof(stages[0]) ? "," : "") << "\n";
+        }
+        json << "      }\n    }";
+        std::cerr << name << ": done, peak RSS " << peakRssKb() << " kB" << std::endl;
+        return true;
+    }
+
+    /** \brief  Runs benchMap in a forked child and reads its
+     *          JSON object back through a pipe. The peak RSS the
+     *          child reports is then that of this map alone, not
+     *          the high-water mark of every map before it.
+     *
+     *          @return bool false if the child failed
+    */
+    bool benchMapInChild(const std::string &name, const std::string &path, unsigned numPairs, unsigned repeats,
+                         unsigned side, std::string &entry)
+    {
+        int ends[2];
+        if (::pipe(ends) != 0)
+        {
+            return false;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        pid_t child = ::fork();
+        if (child < 0)
+        {
+            ::close(ends[0]);
+            ::close(ends[1]);
+            return false;
+        }
+        if (child == 0)
+        {
+            ::close(ends[0]);
+            std::ostringstream json;
+            json << std::fixed << std::setprecision(4);
+            bool ok = benchMap(name, path, numPairs, repeats, side, json);
+            std::string text = json.str();
+            for (size_t done = 0; ok && done < text.size(); )
+            {
+                ssize_t n = ::write(ends[1], text.data() + done, text.size() - done);
+                if (n < 0 && errno != EINTR)
+                {
+                    ok = false;
+                }
+                done += (n > 0) ? static_cast<size_t>(n) : 0;
+            }
+            ::close(ends[1]);
+            std::cerr.flush();
+            ::_exit(ok ? 0 : 1);
+        }
+        ::close(ends[1]);
+        entry.clear();
+        char buffer[4096];
+        ssize_t n;
+        while ((n = ::read(ends[0], buffer, sizeof(buffer))) != 0)
+        {
+            if (n < 0 && errno != EINTR)
+            {
+                break;
+            }
+            entry.append(buffer, (n > 0) ? static_cast<size_t>(n) : 0);
+        }
+        ::close(ends[0]);
+        int status;
+        while (::waitpid(child, &status, 0) < 0 && errno == EINTR)
+        {
+        }
+        return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+
+    /** \brief  Runs the stage benchmarks on the test maps and a
+     *          generated grid and writes the JSON report to out,
+     *          or to standard output if out is "-".
+     *
+     *          @return int exit status
+    */
+    int benchStages(const std::string &out, unsigned numPairs, unsigned repeats, unsigned gridSide)
+    {
+        const unsigned CANVAS = 3000;
+        std::string gridPath = "/tmp/bench_grid_" + std::to_string(gridSide) + ".osm";
+        if (!writeGrid(gridPath, gridSide))
+        {
+            std::cerr << "cannot write " << gridPath << std::endl;
+            return 1;
+        }
+        const char *maps[][2] = { { "fsu", "./tests/fsu.osm" }, { "innovation_park", "./tests/innovation_park.osm" },
+                                  { "grid", gridPath.c_str() } };
+        std::ostringstream json;
+        json << std::fixed << std::setprecision(4);
+        json << "{\n  \"seed\": " << SEED << ",\n  \"pairs\": " << numPairs << ",\n  \"repeats\": " << repeats
+             << ",\n  \"grid_side\": " << gridSide << ",\n  \"maps\": [\n";
+        bool first = true;
+        for (const auto &map : maps)
+        {
+            //Each map runs in its own process, so its peak RSS is its own
+            std::string entry;
+            if (benchMapInChild(map[0], map[1], numPairs, repeats, CANVAS, entry))
+            {
+                json << (first ? "" : ",\n") << entry;
+                first = false;
+            }
+        }
+        json << "\n  ],\n  \"peak_rss_kb\": " << std::max(peakRssKb(), peakRssKb(RUSAGE_CHILDREN)) << "\n}\n";
+        std::remove(gridPath.c_str());
+        if (out == "-")
+        {
+            std::cout << json.str();
+            return 0;
+        }
+        std::ofstream file(out);
+        file << json.str();
+        return file ? 0 : 1;
+    }
+
+    /** \brief  Renders the tiles of a map from minZoom to
+     *          maxZoom into out and reports how many were
+     *          written and how long it took.
+     *
+     *          @return int exit status, 1 if nothing was written
+    */
+    int benchTiles(const std::string &path, const std::string &out, unsigned minZoom, unsigned maxZoom)
+    {
+        const std::string ARCHIVE_SUFFIX = ".tiles";
+        Osm osm(path);
+        std::shared_ptr<const MapState> map = osm.snapshot();
+        TileRenderer renderer(map->graph);
+        bool archive = out.size() > ARCHIVE_SUFFIX.size() &&
+                       out.compare(out.size() - ARCHIVE_SUFFIX.size(), ARCHIVE_SUFFIX.size(), ARCHIVE_SUFFIX) == 0;
+        size_t written;
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            written = archive ? renderer.renderArchive(out, minZoom, maxZoom)
+                              : renderer.renderDirectory(out, minZoom, maxZoom);
+        }
+        catch (const TileRenderer::InvalidZoom &)
+        {
+            std::cerr << "zoom levels must be in [0, " << TileRenderer::MAX_ZOOM << "]" << std::endl;
+            return 1;
+        }
+        catch (const TileRenderer::InvertedZoomRange &)
+        {
+            std::cerr << "min zoom " << minZoom << " is above max zoom " << maxZoom << std::endl;
+            return 1;
+        }
+        std::cout << path << ": " << written << " tiles for zoom " << minZoom << "-" << maxZoom << " in "
+                  << millisSince(start) << " ms to " << out << std::endl;
+        if (archive && written > 0)
+        {
+            double lat = (map->bounds.minLat + map->bounds.maxLat) / 2;
+            double lon = (map->bounds.minLon + map->bounds.maxLon) / 2;
+            uint32_t x = TileRenderer::tileX(lon, maxZoom), y = TileRenderer::tileY(lat, maxZoom);
+            std::string pgm;
+            bool found = TileRenderer::readArchiveTile(out, maxZoom, x, y, pgm);
+            std::cout << "tile " << maxZoom << "/" << x << "/" << y << ": "
+                      << (found ? std::to_string(pgm.size()) + " bytes" : std::string("not in archive")) << std::endl;
+        }
+        return written > 0 ? 0 : 1;
+    }
+}
+
+// usage: bench [map.osm] [pairs] [distance|car|bike|foot]
+//        bench --stages [out.json|-] [pairs] [repeats] [grid side]
+//        bench --tiles [map.osm] [out dir|out.tiles] [min zoom] [max zoom]
+int main(int argc, char **argv) {
+    if (argc > 1 && std::strcmp(argv[1], "--stages") == 0)
+    {
+        return benchStages((argc > 2) ? argv[2] : "-", (argc > 3) ? std::strtoul(argv[3], nullptr, 10) : 200,
+                           (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 5,
+                           (argc > 5) ? std::strtoul(argv[5], nullptr, 10) : 300);
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--tiles") == 0)
+    {
+        return benchTiles((argc > 2) ? argv[2] : "./tests/fsu.osm", (argc > 3) ? argv[3] : "/tmp/tiles",
+                          (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 12,
+                          (argc > 5) ? std::strtoul(argv[5], nullptr, 10) : 16);
+    }
+    std::string path = (argc > 1) ? argv[1] : "./tests/fsu.osm";
+    unsigned numPairs = (argc > 2) ? std::strtoul(argv[2], nullptr, 10) : 1000;
+    OsmLoadOptions options;
+    if (argc > 3 && !Profile::parse(argv[3], options.profile))
+    {
+        std::cerr << "unknown profile " << argv[3] << std::endl;
+        return 1;
+    }
+    Osm osm(path, options);
+    std::shared_ptr<const Graph> graph = osm.getGraph();
+    const Graph &g = *graph;
+
+    //Only nodes with an arc the profile may use can be routed between
+    std::vector<uint32_t> routable;
+    for (uint32_t i = 0; i < g.size(); i++)
+    {
+        if (g.isRoutable(i))
+        {
+            routable.push_back(i);
+        }
+    }
+    if (routable.empty())
+    {
+        std::cerr << "no routable nodes in " << path << std::endl;
+        return 1;
+    }
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pick(0, routable.size() - 1);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    for (unsigned i = 0; i < numPairs; i++)
+    {
+        pairs.push_back(std::make_pair(routable[pick(rng)], routable[pick(rng)]));
+    }
+
+    const Router::Mode modes[] = { Router::BFS, Router::BIDIRECTIONAL_BFS, Router::DIJKSTRA,
+                                   Router::BIDIRECTIONAL_DIJKSTRA, Router::ASTAR,
+                                   Router::CONTRACTION_HIERARCHY };
+    Router router;
+    std::cout << path << ": " << g.size() << " nodes, " << g.arcCount() << " arcs, "
+              << numPairs << " pairs, " << Profile::name(options.profile) << " profile" << std::endl;
+    ContractionHierarchy hierarchy;
+    auto buildStart = std::chrono::steady_clock::now();
+    hierarchy.build(g);
+    auto buildStop = std::chrono::steady_clock::now();
+    std::cout << "contraction hierarchy: " << hierarchy.shortcutCount() << " shortcuts, built in "
+              << std::chrono::duration<double, std::milli>(buildStop - buildStart).count() << " ms" << std::endl;
+    std::uniform_real_distribution<double> pickLat(osm.get_MIN_LAT(), osm.get_MAX_LAT());
+    std::uniform_real_distribution<double> pickLon(osm.get_MIN_LON(), osm.get_MAX_LON());
+    std::vector<std::pair<double, double>> points;
+    for (unsigned i = 0; i < numPairs; i++)
+    {
+        points.push_back(std::make_pair(pickLat(rng), pickLon(rng)));
+    }
+    SpatialIndex index;
+    index.build(g);
+    unsigned long mismatches = 0;
+    auto snapStart = std::chrono::steady_clock::now();
+    std::vector<uint32_t> snapped;
+    for (const std::pair<double, double> &p : points)
+    {
+        snapped.push_back(index.nearest(p.first, p.second));
+    }
+    auto snapStop = std::chrono::steady_clock::now();
+    //The linear scan the index replaces, as a baseline and a check
+    for (size_t i = 0; i < points.size(); i++)
+    {
+        uint32_t closest = Graph::NO_NODE;
+        double closestDistance = 0;
+        for (uint32_t node : routable)
+        {
+            double d = Graph::distance(points[i].first, points[i].second, g.getLat(node), g.getLon(node));
+            if (closest == Graph::NO_NODE || d < closestDistance)
+            {
+                closest = node;
+                closestDistance = d;
+            }
+        }
+        if (closest != snapped[i])
+        {
+            mismatches++;
+        }
+    }
+    auto scanStop = std::chrono::steady_clock::now();
+    std::cout << "nearest node: " << std::chrono::duration<double, std::micro>(snapStop - snapStart).count() / numPairs
+              << " us indexed, " << std::chrono::duration<double, std::micro>(scanStop - snapStop).count() / numPairs
+              << " us linear scan, " << mismatches << " mismatches" << std::endl;
+    std::cout << std::left << std::setw(24) << "mode" << std::right << std::setw(14) << "avg settled"
+              << std::setw(14) << "avg us" << std::setw(16) << "avg length m" << std::setw(14) << "avg cost"
+              << std::setw(14) << "unreachable" << std::endl;
+    double dijkstraCost = 0;
+    unsigned long dijkstraRoutes = 0;
+    for (Router::Mode mode : modes)
+    {
+        unsigned long settled = 0, unreachable = 0;
+        double length = 0, cost = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::pair<uint32_t, uint32_t> &p : pairs)
+        {
+            Route r = (mode == Router::CONTRACTION_HIERARCHY) ?
+                router.route(g, hierarchy, p.first, p.second) : router.route(g, p.first, p.second, mode);
+            settled += r.settled;
+            length += r.distance;
+            if (r.nodes.empty())
+            {
+                unreachable++;
+            }
+            else
+            {
+                cost += r.cost;
+            }
+        }
+        auto stop = std::chrono::steady_clock::now();
+        if (mode == Router::DIJKSTRA)
+        {
+            dijkstraCost = cost;
+            dijkstraRoutes = numPairs - unreachable;
+        }
+        double micros = std::chrono::duration<double, std::micro>(stop - start).count();
+        std::cout << std::left << std::setw(24) << Router::modeName(mode) << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(14) << double(settled) / numPairs
+                  << std::setw(14) << micros / numPairs << std::setw(16) << length / numPairs
+                  << std::setw(14) << cost / numPairs << std::setw(14) << unreachable << std::endl;
+    }
+    if (dijkstraRoutes > 0)
+    {
+        double budget = dijkstraCost / dijkstraRoutes / 2;
+        Isochrone reached;
+        unsigned long nodes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (const std::pair<uint32_t, uint32_t> &p : pairs)
+        {
+            router.reachable(g, p.first, budget, reached);
+            nodes += reached.nodes.size();
+        }
+        auto stop = std::chrono::steady_clock::now();
+        std::cout << "isochrone, budget " << budget << ": " << double(nodes) / numPairs << " nodes reached, "
+                  << std::chrono::duration<double, std::micro>(stop - start).count() / numPairs << " us" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+/**
+ * @brief ChunkScan Class implementation
+ */
+
+#include "chunkscan.hpp"
+#include "osmscanner.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstring>
+
+const size_t ChunkScan::CHUNK_BYTES;
+
+namespace {
+    /** \brief  Returns true if p starts a node, way or relation
+     *          element, the points where a chunk may begin.
+     *
+     *          @return bool
+    */
+    bool startsTopElement(const char *p, const char *end)
+    {
+        const char *names[] = { "<node", "<way", "<relation" };
+        for (const char *name : names)
+        {
+            size_t length = std::strlen(name);
+            if (static_cast<size_t>(end - p) > length && std::memcmp(p, name, length) == 0 &&
+                (p[length] == ' ' || p[length] == '\t' || p[length] == '>' || p[length] == '/' ||
+                 p[length] == '\n' || p[length] == '\r'))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+/** \brief  Clears the results of the last scan, keeping the
+ *          memory, and sets up the next one.
+ *
+ *          @return void
+*/
+void ChunkScan::reset(Kind scanKind)
+{
+    kind = scanKind;
+    ids.clear();
+    lats.clear();
+    lons.clear();
+    edges.clear();
+    edgeAttributes.clear();
+    refs.clear();
+    wayIds.clear();
+    wayEdges.clear();
+    hasNode = false;
+    minLat = minLon = maxLat = maxLon = 0;
+}
+
+/** \brief  Grows the bounds to take in the node and records
+ *          it.
+ *
+ *          @return void
+*/
+void ChunkScan::addNode(uint64_t id, double lat, double lon)
+{
+    METRICS_COUNT(NODES_PARSED, 1);
+    if (!hasNode)
+    {
+        minLat = maxLat = lat;
+        minLon = maxLon = lon;
+        hasNode = true;
+    }
+    else
+    {
+        minLat = std::min(minLat, lat);
+        maxLat = std::max(maxLat, lat);
+        minLon = std::min(minLon, lon);
+        maxLon = std::max(maxLon, lon);
+    }
+    ids.push_back(id);
+    lats.push_back(lat);
+    lons.push_back(lon);
+}
+
+/** \brief  A highway way connects each consecutive pair of
+ *          its refs, every edge carrying the way's attributes.
+ *          Ways with at least one edge are listed with their
+ *          edge count, and WAYS scans also collect their refs.
+ *
+ *          @return void
+*/
+void ChunkScan::addHighway(uint64_t wayId, const std::vector<uint64_t> &wayRefs, const EdgeAttributes &attributes)
+{
+    METRICS_COUNT(WAYS_PARSED, 1);
+    for (size_t i = 1; i < wayRefs.size(); i++)
+    {
+        edges.push_back(std::make_pair(wayRefs[i - 1], wayRefs[i]));
+        edgeAttributes.push_back(attributes);
+    }
+    if (wayRefs.size() > 1)
+    {
+        wayIds.push_back(wayId);
+        wayEdges.push_back(static_cast<uint32_t>(wayRefs.size() - 1));
+        if (kind == WAYS)
+        {
+            refs.insert(refs.end(), wayRefs.begin(), wayRefs.end());
+        }
+    }
+}
+
+/** \brief  Reads the XML elements in [begin, end), which
+ *          must start at an element boundary, passing nodes to
+ *          addNode and ways tagged as highways to addHighway.
+ *
+ *          @return void
+*/
+void ChunkScan::scan(const char *begin, const char *end)
+{
+    OsmScanner scanner(begin, end);
+    OsmScanner::Span id, lat, lon, key, value;
+    uint64_t wayId = 0;
+    std::vector<uint64_t> wayRefs;
+    WayTags tags;
+    bool inWay = false;
+    bool readNodes = (kind != WAYS), readWays = (kind != NODES);
+    OsmScanner::Element element;
+    while ((element = scanner.next()) != OsmScanner::DONE)
+    {
+        switch (element)
+        {
+            case OsmScanner::NODE:
+                if (readNodes && scanner.getAttribute("id", id) && scanner.getAttribute("lat", lat) &&
+                    scanner.getAttribute("lon", lon))
+                {
+                    addNode(id.toId(), lat.toDouble(), lon.toDouble());
+                }
+                break;
+            case OsmScanner::WAY:
+                wayRefs.clear();
+                tags.clear();
+                wayId = scanner.getAttribute("id", id) ? id.toId() : 0;
+                inWay = readWays && !scanner.isSelfClosing();
+                break;
+            case OsmScanner::ND:
+                if (inWay && scanner.getAttribute("ref", id))
+                {
+                    wayRefs.push_back(id.toId());
+                }
+                break;
+            case OsmScanner::TAG:
+                if (inWay && scanner.getAttribute("k", key) && scanner.getAttribute("v", value))
+                {
+                    tags.add(key.begin, key.end - key.begin, value.begin, value.end - value.begin);
+                }
+                break;
+            case OsmScanner::WAY_END:
+                if (inWay && tags.isHighway())
+                {
+                    addHighway(wayId, wayRefs, tags.finish());
+                }
+                inWay = false;
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/** \brief  Splits [begin, end) into chunks of about
+ *          CHUNK_BYTES. Each chunk after the first starts at
+ *          a node, way or relation element that begins a
+ *          line, so no element is split between chunks.
+ *
+ *          @return std::vector<const char *>
+*/
+std::vector<const char *> ChunkScan::split(const char *begin, const char *end)
+{
+    std::vector<const char *> starts(1, begin);
+    const char *pos = begin + std::min<size_t>(CHUNK_BYTES, end - begin);
+    while (pos < end)
+    {
+        const char *line = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        if (line == nullptr)
+        {
+            break;
+        }
+        const char *p = line + 1;
+        while (p < end && (*p == ' ' || *p == '\t'))
+        {
+            p++;
+        }
+        if (startsTopElement(p, end))
+        {
+            starts.push_back(p);
+            pos = p + std::min<size_t>(CHUNK_BYTES, end - p);
+        }
+        else
+        {
+            pos = line + 1;
+        }
+    }
+    return starts;
+}
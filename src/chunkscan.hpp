@@ -0,0 +1,44 @@
+/**
+ * @brief ChunkScan Class header
+ */
+#ifndef CHUNKSCAN_H
+#define CHUNKSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include "profile.hpp"
+
+// Nodes, highway edges and refs read from one chunk of an .osm or .osm.pbf file.
+// Chunks are scanned independently, so several can be read at once.
+struct ChunkScan {
+    // What a scan collects
+    enum Kind { NODES_AND_WAYS, NODES, WAYS };
+    // Target size of the chunks made by split
+    static const size_t CHUNK_BYTES = size_t(1) << 20;
+
+    Kind kind;
+    std::vector<uint64_t> ids;                      /** Nodes in file order. */
+    std::vector<double> lats, lons;
+    std::vector<std::pair<uint64_t, uint64_t>> edges; /** Consecutive refs of highway ways, in file order. */
+    std::vector<EdgeAttributes> edgeAttributes;     /** Attributes of the way each edge comes from. */
+    std::vector<uint64_t> refs;                     /** Every ref of a highway way, WAYS scans only. */
+    std::vector<uint64_t> wayIds;                   /** Highway ways with an edge, in file order. */
+    std::vector<uint32_t> wayEdges;                 /** Edges of each of those ways, which are consecutive in edges. */
+    bool hasNode;                                   /** True once a node has been seen. */
+    double minLat, minLon, maxLat, maxLon;          /** Bounds of every node seen. */
+
+    //Clears the results for a new scan
+    void reset(Kind scanKind);
+    //Reads the XML elements in [begin, end)
+    void scan(const char *begin, const char *end);
+    //Records a node and grows the bounds
+    void addNode(uint64_t id, double lat, double lon);
+    //Records the edges, and for WAYS scans the refs, of a highway way
+    void addHighway(uint64_t wayId, const std::vector<uint64_t> &wayRefs, const EdgeAttributes &attributes);
+    //Start of every chunk of about CHUNK_BYTES, the first being begin
+    static std::vector<const char *> split(const char *begin, const char *end);
+};
+
+#endif
@@ -0,0 +1,568 @@
+/**
+ * @brief Graph Class implementation
+ */
+
+#include "graph.hpp"
+#include "mappedfile.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <limits>
+
+const uint32_t Graph::NO_NODE;
+
+namespace {
+    const char MAGIC[8] = { 'O', 'S', 'M', 'G', 'R', 'A', 'P', 'H' };
+    const uint32_t FORMAT_VERSION = 2;
+    // Written in native byte order, so a file from a machine of the other endianness does not match
+    const uint32_t BYTE_ORDER_MARK = 0x01020304u;
+    // Sections in file order: ids, lats, lons, offsets, targets, lengths, attributes
+    const int SECTIONS = 7;
+
+    // Fixed-size header at the start of a snapshot. Every section
+    // follows it in order, each padded with zeros to 8 bytes.
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t byteOrder;
+        uint64_t nodes;
+        uint64_t arcs;
+        double bounds[4];
+        uint64_t sectionChecksums[SECTIONS];
+        // Checksum of every header field above
+        uint64_t headerChecksum;
+    };
+
+    size_t padded(size_t bytes)
+    {
+        return (bytes + 7) & ~static_cast<size_t>(7);
+    }
+
+    /** \brief  FNV-1a style hash taken a 64-bit word at a time,
+     *          so checking a large snapshot stays fast. A last
+     *          partial word is hashed as if padded with zeros,
+     *          which is how sections are stored.
+     *
+     *          @return uint64_t
+    */
+    uint64_t checksum(const char *data, size_t bytes)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        const uint64_t PRIME = 1099511628211ull;
+        for (size_t i = 0; i < bytes; i += 8)
+        {
+            uint64_t word = 0;
+            std::memcpy(&word, data + i, std::min<size_t>(8, bytes - i));
+            hash = (hash ^ word) * PRIME;
+            hash ^= hash >> 29;
+        }
+        return hash;
+    }
+}
+
+/** \brief  Constructor for an empty graph. Nodes and edges
+ *          are added with addNode and addEdge, then build()
+ *          lays them out for querying.
+*/
+Graph::Graph()
+{
+    offsets.push_back(0);
+    useOwnedArrays();
+}
+
+/** \brief  Copy constructor. A mapped graph shares the
+ *          snapshot with the copy, a built one is copied.
+*/
+Graph::Graph(const Graph &other)
+        :ids(other.ids), lats(other.lats), lons(other.lons), offsets(other.offsets),
+         targets(other.targets), lengths(other.lengths), attributes(other.attributes),
+         pendingEdges(other.pendingEdges), pendingAttributes(other.pendingAttributes),
+         profile(other.profile), weights(other.weights), reverseWeights(other.reverseWeights),
+         nodeCount(other.nodeCount), arcTotal(other.arcTotal), idData(other.idData),
+         latData(other.latData), lonData(other.lonData), offsetData(other.offsetData),
+         targetData(other.targetData), lengthData(other.lengthData), attributeData(other.attributeData),
+         snapshot(other.snapshot)
+{
+    if (!snapshot)
+    {
+        useOwnedArrays();
+    }
+}
+
+/** \brief  Assignment operator, with the same sharing as the
+ *          copy constructor.
+ *
+ *          @return Graph &
+*/
+Graph& Graph::operator=(const Graph &other)
+{
+    if (this != &other)
+    {
+        Graph copy(other);
+        ids.swap(copy.ids);
+        lats.swap(copy.lats);
+        lons.swap(copy.lons);
+        offsets.swap(copy.offsets);
+        targets.swap(copy.targets);
+        lengths.swap(copy.lengths);
+        attributes.swap(copy.attributes);
+        pendingEdges.swap(copy.pendingEdges);
+        pendingAttributes.swap(copy.pendingAttributes);
+        weights.swap(copy.weights);
+        reverseWeights.swap(copy.reverseWeights);
+        profile = copy.profile;
+        snapshot.swap(copy.snapshot);
+        nodeCount = copy.nodeCount;
+        arcTotal = copy.arcTotal;
+        idData = copy.idData;
+        latData = copy.latData;
+        lonData = copy.lonData;
+        offsetData = copy.offsetData;
+        targetData = copy.targetData;
+        lengthData = copy.lengthData;
+        attributeData = copy.attributeData;
+    }
+    return *this;
+}
+
+/** \brief  Points the query arrays at the owned vectors and
+ *          lets go of any mapped snapshot.
+ *
+ *          @return void
+*/
+void Graph::useOwnedArrays()
+{
+    snapshot.reset();
+    nodeCount = ids.size();
+    arcTotal = targets.size();
+    idData = ids.data();
+    latData = lats.data();
+    lonData = lons.data();
+    offsetData = offsets.data();
+    targetData = targets.data();
+    lengthData = lengths.data();
+    attributeData = attributes.data();
+}
+
+/** \brief  Adds a node with the given OSM id and coordinates.
+ *          If the same id is added more than once the first
+ *          occurrence is kept.
+ *
+ *          @return void
+*/
+void Graph::addNode(uint64_t id, double lat, double lon)
+{
+    ids.push_back(id);
+    lats.push_back(lat);
+    lons.push_back(lon);
+}
+
+/** \brief  Records an edge from idOne to idTwo with the
+ *          attributes of its way. Edges are resolved to node
+ *          indices in build(), so nodes and edges can be added
+ *          in any order.
+ *
+ *          @return void
+*/
+void Graph::addEdge(uint64_t idOne, uint64_t idTwo, const EdgeAttributes &edgeAttributes)
+{
+    pendingEdges.push_back(std::make_pair(idOne, idTwo));
+    pendingAttributes.push_back(edgeAttributes);
+}
+
+/** \brief  Sorts the nodes by id so each id maps to a dense
+ *          index, then converts the recorded edges into the
+ *          compressed sparse row arrays. Every edge becomes
+ *          two arcs, and each node's neighbors keep the order
+ *          in which their edges were added. Edges that name
+ *          an unknown node are dropped. The length of every
+ *          arc is computed here so searches can read it, and
+ *          the arcs are weighted by the current profile. The
+ *          arc running against its edge has the edge's oneway
+ *          flipped.
+ *          Nodes and edges are only added to built graphs,
+ *          not to ones mapped from a snapshot.
+ *
+ *          @return void
+*/
+void Graph::build()
+{
+    size_t n = ids.size();
+    if (!std::is_sorted(ids.begin(), ids.end()))
+    {
+        std::vector<uint32_t> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+            [this](uint32_t a, uint32_t b) { return ids[a] < ids[b]; });
+        std::vector<uint64_t> sortedIds(n);
+        std::vector<double> sortedLats(n), sortedLons(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            sortedIds[i] = ids[order[i]];
+            sortedLats[i] = lats[order[i]];
+            sortedLons[i] = lons[order[i]];
+        }
+        ids.swap(sortedIds);
+        lats.swap(sortedLats);
+        lons.swap(sortedLons);
+    }
+    //Drop repeated ids, keeping the first one added
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (kept == 0 || ids[i] != ids[kept - 1])
+        {
+            ids[kept] = ids[i];
+            lats[kept] = lats[i];
+            lons[kept] = lons[i];
+            kept++;
+        }
+    }
+    ids.resize(kept);
+    lats.resize(kept);
+    lons.resize(kept);
+    ids.shrink_to_fit();
+    lats.shrink_to_fit();
+    lons.shrink_to_fit();
+    n = kept;
+    useOwnedArrays();
+
+    //Resolve ids once, then count arcs per node
+    std::vector<std::pair<uint32_t, uint32_t>> arcs;
+    std::vector<EdgeAttributes> arcAttributes;
+    arcs.reserve(pendingEdges.size() * 2);
+    arcAttributes.reserve(pendingEdges.size() * 2);
+    for (size_t e = 0; e < pendingEdges.size(); e++)
+    {
+        uint32_t one = indexOf(pendingEdges[e].first);
+        uint32_t two = indexOf(pendingEdges[e].second);
+        if (one != NO_NODE && two != NO_NODE)
+        {
+            EdgeAttributes back = pendingAttributes[e];
+            if (back.oneway != Profile::BOTH_WAYS)
+            {
+                back.oneway = (back.oneway == Profile::ALONG) ? Profile::AGAINST : Profile::ALONG;
+            }
+            arcs.push_back(std::make_pair(one, two));
+            arcAttributes.push_back(pendingAttributes[e]);
+            arcs.push_back(std::make_pair(two, one));
+            arcAttributes.push_back(back);
+        }
+    }
+    std::vector<std::pair<uint64_t, uint64_t>>().swap(pendingEdges);
+    std::vector<EdgeAttributes>().swap(pendingAttributes);
+
+    offsets.assign(n + 1, 0);
+    for (const std::pair<uint32_t, uint32_t> &arc : arcs)
+    {
+        offsets[arc.first + 1]++;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        offsets[i + 1] += offsets[i];
+    }
+    targets.assign(arcs.size(), 0);
+    attributes.resize(arcs.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < arcs.size(); i++)
+    {
+        uint32_t a = fill[arcs[i].first]++;
+        targets[a] = arcs[i].second;
+        attributes[a] = arcAttributes[i];
+    }
+    lengths.assign(targets.size(), 0);
+    for (uint32_t u = 0; u < n; u++)
+    {
+        for (uint32_t a = offsets[u]; a < offsets[u + 1]; a++)
+        {
+            lengths[a] = static_cast<float>(distance(lats[u], lons[u], lats[targets[a]], lons[targets[a]]));
+        }
+    }
+    useOwnedArrays();
+    computeWeights();
+}
+
+/** \brief  Switches to another profile and weighs every arc
+ *          for it.
+ *
+ *          @return void
+*/
+void Graph::setProfile(const Profile &newProfile)
+{
+    profile = newProfile;
+    computeWeights();
+}
+
+/** \brief  Returns the profile the arcs are weighted for.
+ *
+ *          @return const Profile &
+*/
+const Profile &Graph::getProfile() const
+{
+    return profile;
+}
+
+/** \brief  Fills in the weight of every arc, and of the arc
+ *          going the other way, from its length and attributes.
+ *          The other arc has the same length and attributes
+ *          with the oneway flipped, so it need not be found.
+ *
+ *          @return void
+*/
+void Graph::computeWeights()
+{
+    weights.resize(arcTotal);
+    reverseWeights.resize(arcTotal);
+    for (size_t a = 0; a < arcTotal; a++)
+    {
+        weights[a] = profile.weight(attributeData[a], lengthData[a], false);
+        reverseWeights[a] = profile.weight(attributeData[a], lengthData[a], true);
+    }
+}
+
+/** \brief  Returns true if the profile lets a route start or
+ *          end at node i, meaning one of its arcs may be used
+ *          leaving or entering it.
+ *
+ *          @return bool
+*/
+bool Graph::isRoutable(uint32_t i) const
+{
+    const float NO_ACCESS = std::numeric_limits<float>::infinity();
+    for (uint32_t a = offsetData[i]; a < offsetData[i + 1]; a++)
+    {
+        if (weights[a] != NO_ACCESS || reverseWeights[a] != NO_ACCESS)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** \brief  Returns the great-circle distance in metres between
+ *          two coordinates given in degrees, using the
+ *          haversine formula on a spherical earth.
+ *
+ *          @return double
+*/
+double Graph::distance(double latOne, double lonOne, double latTwo, double lonTwo)
+{
+    const double EARTH_RADIUS = 6371008.8;
+    const double TO_RAD = 3.14159265358979323846 / 180.0;
+    double dLat = (latTwo - latOne) * TO_RAD;
+    double dLon = (lonTwo - lonOne) * TO_RAD;
+    double sinLat = std::sin(dLat / 2), sinLon = std::sin(dLon / 2);
+    double h = sinLat * sinLat + std::cos(latOne * TO_RAD) * std::cos(latTwo * TO_RAD) * sinLon * sinLon;
+    return 2 * EARTH_RADIUS * std::asin(std::min(1.0, std::sqrt(h)));
+}
+
+/** \brief  Returns the number of nodes in the graph.
+ *
+ *          @return size_t
+*/
+size_t Graph::size() const
+{
+    return nodeCount;
+}
+
+/** \brief  Returns the number of directed arcs, which is
+ *          twice the number of edges.
+ *
+ *          @return size_t
+*/
+size_t Graph::arcCount() const
+{
+    return arcTotal;
+}
+
+/** \brief  Returns the dense index of the node with the
+ *          given OSM id, or NO_NODE if there is none.
+ *
+ *          @return uint32_t
+*/
+uint32_t Graph::indexOf(uint64_t id) const
+{
+    const uint64_t *last = idData + nodeCount;
+    const uint64_t *it = std::lower_bound(idData, last, id);
+    if (it == last || *it != id)
+    {
+        return NO_NODE;
+    }
+    return static_cast<uint32_t>(it - idData);
+}
+
+/** \brief  Returns true if the file at path starts with the
+ *          snapshot magic bytes, whatever its version.
+ *
+ *          @return bool
+*/
+bool Graph::isSnapshot(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+/** \brief  Writes the built graph and the given bounds to a
+ *          snapshot file. The arrays are written exactly as
+ *          they are laid out in memory, so mapSnapshot can
+ *          use the file in place.
+ *
+ *          @return bool true if the file was written
+*/
+bool Graph::saveSnapshot(const std::string &path, const Bounds &bounds) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    const char *sections[SECTIONS] = {
+        reinterpret_cast<const char *>(idData), reinterpret_cast<const char *>(latData),
+        reinterpret_cast<const char *>(lonData), reinterpret_cast<const char *>(offsetData),
+        reinterpret_cast<const char *>(targetData), reinterpret_cast<const char *>(lengthData),
+        reinterpret_cast<const char *>(attributeData) };
+    size_t bytes[SECTIONS] = { nodeCount * sizeof(uint64_t), nodeCount * sizeof(double),
+                               nodeCount * sizeof(double), (nodeCount + 1) * sizeof(uint32_t),
+                               arcTotal * sizeof(uint32_t), arcTotal * sizeof(float),
+                               arcTotal * sizeof(EdgeAttributes) };
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.nodes = nodeCount;
+    header.arcs = arcTotal;
+    header.bounds[0] = bounds.minLat;
+    header.bounds[1] = bounds.minLon;
+    header.bounds[2] = bounds.maxLat;
+    header.bounds[3] = bounds.maxLon;
+    for (int i = 0; i < SECTIONS; i++)
+    {
+        header.sectionChecksums[i] = checksum(sections[i], bytes[i]);
+    }
+    header.headerChecksum = checksum(reinterpret_cast<const char *>(&header),
+                                     offsetof(SnapshotHeader, headerChecksum));
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    const char zeros[8] = { 0 };
+    for (int i = 0; i < SECTIONS; i++)
+    {
+        out.write(sections[i], bytes[i]);
+        out.write(zeros, padded(bytes[i]) - bytes[i]);
+    }
+    return out.good();
+}
+
+/** \brief  Checks what the queries rely on, for arrays
+ *          mapped from a snapshot whose checksums may match a
+ *          file that was never valid: the ids are sorted for
+ *          indexOf, the offsets start at 0, never decrease and
+ *          end at m, every target is a node, and every length
+ *          is a finite, non-negative number of metres. Runs in
+ *          O(n + m).
+ *
+ *          @return bool true if the arrays can be queried
+*/
+bool Graph::isWellFormed(size_t n, size_t m, const uint64_t *nodeIds, const uint32_t *arcOffsets,
+                         const uint32_t *arcTargets, const float *arcLengths)
+{
+    if (arcOffsets[0] != 0 || arcOffsets[n] != m)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        if (arcOffsets[i] > arcOffsets[i + 1] || (i > 0 && nodeIds[i - 1] > nodeIds[i]))
+        {
+            return false;
+        }
+    }
+    for (size_t a = 0; a < m; a++)
+    {
+        if (arcTargets[a] >= n || !(arcLengths[a] >= 0) || std::isinf(arcLengths[a]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/** \brief  Maps a snapshot written by saveSnapshot and
+ *          queries it in place. Only the arc weights are
+ *          computed, for the current profile. The file is
+ *          rejected, leaving this graph unchanged, if it has
+ *          the wrong magic, format version or byte order, if
+ *          its size does not match the header, if any checksum
+ *          fails, or if its arrays fail isWellFormed.
+ *
+ *          @return bool true if the snapshot was mapped
+*/
+bool Graph::mapSnapshot(const std::string &path, Bounds &bounds)
+{
+    std::shared_ptr<const MappedFile> file = std::make_shared<const MappedFile>(path, false);
+    if (!file->isOpen() || file->size() < sizeof(SnapshotHeader))
+    {
+        return false;
+    }
+    SnapshotHeader header;
+    std::memcpy(&header, file->begin(), sizeof(header));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION ||
+        header.byteOrder != BYTE_ORDER_MARK || header.headerChecksum !=
+        checksum(reinterpret_cast<const char *>(&header), offsetof(SnapshotHeader, headerChecksum)) ||
+        header.nodes >= NO_NODE || header.arcs >= NO_NODE)
+    {
+        return false;
+    }
+    size_t n = static_cast<size_t>(header.nodes), m = static_cast<size_t>(header.arcs);
+    size_t bytes[SECTIONS] = { n * sizeof(uint64_t), n * sizeof(double), n * sizeof(double),
+                               (n + 1) * sizeof(uint32_t), m * sizeof(uint32_t), m * sizeof(float),
+                               m * sizeof(EdgeAttributes) };
+    const char *sections[SECTIONS];
+    size_t offset = sizeof(SnapshotHeader);
+    for (int i = 0; i < SECTIONS; i++)
+    {
+        size_t length = padded(bytes[i]);
+        if (file->size() - offset < length ||
+            checksum(file->begin() + offset, bytes[i]) != header.sectionChecksums[i])
+        {
+            return false;
+        }
+        sections[i] = file->begin() + offset;
+        offset += length;
+    }
+    const uint32_t *newOffsets = reinterpret_cast<const uint32_t *>(sections[3]);
+    if (offset != file->size() ||
+        !isWellFormed(n, m, reinterpret_cast<const uint64_t *>(sections[0]), newOffsets,
+                      reinterpret_cast<const uint32_t *>(sections[4]), reinterpret_cast<const float *>(sections[5])))
+    {
+        return false;
+    }
+    std::vector<uint64_t>().swap(ids);
+    std::vector<double>().swap(lats);
+    std::vector<double>().swap(lons);
+    std::vector<uint32_t>().swap(offsets);
+    std::vector<uint32_t>().swap(targets);
+    std::vector<float>().swap(lengths);
+    std::vector<EdgeAttributes>().swap(attributes);
+    std::vector<std::pair<uint64_t, uint64_t>>().swap(pendingEdges);
+    std::vector<EdgeAttributes>().swap(pendingAttributes);
+    snapshot = file;
+    nodeCount = n;
+    arcTotal = m;
+    idData = reinterpret_cast<const uint64_t *>(sections[0]);
+    latData = reinterpret_cast<const double *>(sections[1]);
+    lonData = reinterpret_cast<const double *>(sections[2]);
+    offsetData = newOffsets;
+    targetData = reinterpret_cast<const uint32_t *>(sections[4]);
+    lengthData = reinterpret_cast<const float *>(sections[5]);
+    attributeData = reinterpret_cast<const EdgeAttributes *>(sections[6]);
+    computeWeights();
+    bounds.minLat = header.bounds[0];
+    bounds.minLon = header.bounds[1];
+    bounds.maxLat = header.bounds[2];
+    bounds.maxLon = header.bounds[3];
+    return true;
+}
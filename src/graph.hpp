@@ -0,0 +1,118 @@
+/**
+ * @brief Graph Class header
+ */
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <string>
+#include <memory>
+#include "profile.hpp"
+
+class MappedFile;
+
+class Graph {
+    public:
+        // Index returned for ids that are not in the graph
+        static const uint32_t NO_NODE = 0xffffffffu;
+        // Contiguous range of neighbor indices of one node
+        struct NeighborRange {
+            const uint32_t *first;
+            const uint32_t *last;
+            const uint32_t *begin() const { return first; }
+            const uint32_t *end() const { return last; }
+            size_t size() const { return static_cast<size_t>(last - first); }
+        };
+        // Lat/lon box saved alongside the graph in a snapshot
+        struct Bounds {
+            double minLat, minLon, maxLat, maxLon;
+        };
+
+    private:
+        // Node i has OSM id ids[i]; ids are kept sorted so lookups are a binary search
+        std::vector<uint64_t> ids;
+        std::vector<double> lats, lons;
+        // Neighbors of node i are targets[offsets[i]] .. targets[offsets[i+1]-1]
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> targets;
+        // Great-circle length in metres of each arc, parallel to targets
+        std::vector<float> lengths;
+        // Attributes of the way each arc comes from, parallel to targets,
+        // with oneway taken relative to the arc
+        std::vector<EdgeAttributes> attributes;
+        // Edges added before build(), stored as pairs of OSM ids
+        std::vector<std::pair<uint64_t, uint64_t>> pendingEdges;
+        std::vector<EdgeAttributes> pendingAttributes;
+        // Cost of each arc under the profile, and of the arc going the
+        // other way between the same two nodes. Always owned, since they
+        // are derived from the arrays below when the profile is applied.
+        Profile profile;
+        std::vector<float> weights, reverseWeights;
+        // Arrays read by the queries, pointing into the vectors above
+        // or into a mapped snapshot
+        size_t nodeCount, arcTotal;
+        const uint64_t *idData;
+        const double *latData, *lonData;
+        const uint32_t *offsetData, *targetData;
+        const float *lengthData;
+        const EdgeAttributes *attributeData;
+        // Snapshot the arrays point into, null for a built graph
+        std::shared_ptr<const MappedFile> snapshot;
+
+        void useOwnedArrays();
+        void computeWeights();
+        // True if CSR arrays read from a snapshot are safe to query
+        static bool isWellFormed(size_t n, size_t m, const uint64_t *nodeIds, const uint32_t *arcOffsets,
+                                 const uint32_t *arcTargets, const float *arcLengths);
+
+    public:
+        Graph();
+        Graph(const Graph &);
+        Graph& operator=(const Graph &);
+        // Great-circle distance in metres between two coordinates
+        static double distance(double latOne, double lonOne, double latTwo, double lonTwo);
+        // Building
+        void addNode(uint64_t id, double lat, double lon);
+        void addEdge(uint64_t idOne, uint64_t idTwo, const EdgeAttributes &edgeAttributes);
+        void build();
+        // Weights every arc for a mode of travel
+        void setProfile(const Profile &newProfile);
+        const Profile &getProfile() const;
+        // Snapshots: a versioned binary image of the built arrays that is mapped and used in place
+        static bool isSnapshot(const std::string &path);
+        bool saveSnapshot(const std::string &path, const Bounds &bounds) const;
+        bool mapSnapshot(const std::string &path, Bounds &bounds);
+        // Queries
+        size_t size() const;
+        size_t arcCount() const;
+        uint32_t indexOf(uint64_t id) const;
+        uint64_t getID(uint32_t i) const { return idData[i]; }
+        double getLat(uint32_t i) const { return latData[i]; }
+        double getLon(uint32_t i) const { return lonData[i]; }
+        // Coordinates of all nodes, indexed like getLat and getLon, for passes over every node
+        const double *latitudes() const { return latData; }
+        const double *longitudes() const { return lonData; }
+        uint32_t degree(uint32_t i) const { return offsetData[i + 1] - offsetData[i]; }
+        // Arcs of node i are the indices arcBegin(i) .. arcEnd(i)-1
+        uint32_t arcBegin(uint32_t i) const { return offsetData[i]; }
+        uint32_t arcEnd(uint32_t i) const { return offsetData[i + 1]; }
+        uint32_t arcTarget(uint32_t a) const { return targetData[a]; }
+        float arcLength(uint32_t a) const { return lengthData[a]; }
+        const EdgeAttributes &arcAttributes(uint32_t a) const { return attributeData[a]; }
+        // Cost of arc a under the profile, infinity if it may not be used
+        float arcWeight(uint32_t a) const { return weights[a]; }
+        // Cost of going from arcTarget(a) back to the source of a
+        float arcReverseWeight(uint32_t a) const { return reverseWeights[a]; }
+        // True if some arc of node i may be used in either direction
+        bool isRoutable(uint32_t i) const;
+        NeighborRange neighbors(uint32_t i) const
+        {
+            NeighborRange range = { targetData + offsetData[i], targetData + offsetData[i + 1] };
+            return range;
+        }
+};
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @brief Read-only views of the nodes of a Graph
+ */
+#ifndef GRAPHVIEW_H
+#define GRAPHVIEW_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include "graph.hpp"
+
+class NeighborView;
+
+// One node of a graph, read in place. Views made from a Graph reference
+// hold only a pointer and an index and stay valid while the graph does.
+// Views made from a shared_ptr share ownership of the graph, or of the
+// map version it belongs to, and keep it alive themselves.
+class NodeView {
+    private:
+        std::shared_ptr<const Graph> graph;
+        uint32_t i;
+
+    public:
+        NodeView(const Graph &g, uint32_t index) : graph(std::shared_ptr<const Graph>(), &g), i(index) {}
+        NodeView(const std::shared_ptr<const Graph> &g, uint32_t index) : graph(g), i(index) {}
+        uint32_t index() const { return i; }
+        uint64_t id() const { return graph->getID(i); }
+        double lat() const { return graph->getLat(i); }
+        double lon() const { return graph->getLon(i); }
+        size_t degree() const { return graph->degree(i); }
+        // Nodes sharing an edge with this one
+        NeighborView neighbors() const;
+};
+
+// Every node of a graph in index order
+class NodeRange {
+    private:
+        std::shared_ptr<const Graph> graph;
+
+    public:
+        class iterator {
+            private:
+                std::shared_ptr<const Graph> graph;
+                uint32_t i;
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef NodeView value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef void pointer;
+                typedef NodeView reference;
+                iterator(const std::shared_ptr<const Graph> &g, uint32_t index) : graph(g), i(index) {}
+                NodeView operator*() const { return NodeView(graph, i); }
+                iterator &operator++() { i++; return *this; }
+                iterator operator++(int) { iterator old = *this; i++; return old; }
+                bool operator==(const iterator &other) const { return i == other.i; }
+                bool operator!=(const iterator &other) const { return i != other.i; }
+        };
+        explicit NodeRange(const Graph &g) : graph(std::shared_ptr<const Graph>(), &g) {}
+        explicit NodeRange(const std::shared_ptr<const Graph> &g) : graph(g) {}
+        iterator begin() const { return iterator(graph, 0); }
+        iterator end() const { return iterator(graph, static_cast<uint32_t>(graph->size())); }
+        size_t size() const { return graph->size(); }
+        NodeView operator[](uint32_t index) const { return NodeView(graph, index); }
+};
+
+// The neighbors of one node, read from the graph's adjacency arrays
+class NeighborView {
+    private:
+        std::shared_ptr<const Graph> graph;
+        Graph::NeighborRange range;
+
+    public:
+        class iterator {
+            private:
+                std::shared_ptr<const Graph> graph;
+                const uint32_t *position;
+            public:
+                typedef std::forward_iterator_tag iterator_category;
+                typedef NodeView value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef void pointer;
+                typedef NodeView reference;
+                iterator(const std::shared_ptr<const Graph> &g, const uint32_t *at) : graph(g), position(at) {}
+                NodeView operator*() const { return NodeView(graph, *position); }
+                iterator &operator++() { position++; return *this; }
+                iterator operator++(int) { iterator old = *this; position++; return old; }
+                bool operator==(const iterator &other) const { return position == other.position; }
+                bool operator!=(const iterator &other) const { return position != other.position; }
+        };
+        NeighborView(const std::shared_ptr<const Graph> &g, uint32_t node) : graph(g), range(g->neighbors(node)) {}
+        iterator begin() const { return iterator(graph, range.begin()); }
+        iterator end() const { return iterator(graph, range.end()); }
+        size_t size() const { return range.size(); }
+        // Graph indices of the neighbors, for code that works on indices. Returned
+        // by value, so node.neighbors().indices() outlives the view it came from.
+        Graph::NeighborRange indices() const { return range; }
+};
+
+inline NeighborView NodeView::neighbors() const
+{
+    return NeighborView(graph, i);
+}
+
+#endif
@@ -0,0 +1,568 @@
+/**
+ * @brief ContractionHierarchy Class implementation
+ */
+
+#include "hierarchy.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+    const double INF = std::numeric_limits<double>::infinity();
+    const char MAGIC[8] = { 'O', 'S', 'M', 'C', 'H', 'I', 'E', 'R' };
+    const uint32_t FORMAT_VERSION = 2;
+    // Witness searches give up after settling this many nodes
+    const unsigned WITNESS_SETTLE_LIMIT = 500;
+
+    struct FileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t nodes;
+        uint32_t edges[2];
+        uint32_t reserved;
+        uint32_t padding;   /** Written as zero, keeps graphFingerprint 8-byte aligned. */
+        uint64_t graphFingerprint;
+    };
+
+    // Edge of the graph while it is being contracted
+    struct WorkEdge {
+        uint32_t to;
+        uint32_t middle;
+        double weight;
+    };
+
+    typedef std::pair<double, uint32_t> QueueItem;
+    typedef std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> MinQueue;
+
+    /** \brief  State of the node contraction, kept together so the
+     *          helpers below can share it. Every arc is held both
+     *          in the out list of its source and the in list of
+     *          its target, where WorkEdge::to is the source.
+    */
+    class Contractor {
+        public:
+            std::vector<std::vector<WorkEdge>> out, in;
+            std::vector<bool> contracted;
+            std::vector<int> deletedNeighbors;
+            std::vector<double> witnessDist;
+            std::vector<uint32_t> witnessTouched;
+
+            explicit Contractor(const Graph &g)
+                :out(g.size()), in(g.size()), contracted(g.size(), false), deletedNeighbors(g.size(), 0),
+                 witnessDist(g.size(), INF)
+            {
+                for (uint32_t u = 0; u < g.size(); u++)
+                {
+                    for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+                    {
+                        if (g.arcTarget(a) != u && g.arcWeight(a) != INF)
+                        {
+                            addOrLower(u, g.arcTarget(a), g.arcWeight(a), Graph::NO_NODE);
+                        }
+                    }
+                }
+            }
+
+            /** \brief  Adds the entry for other to list, or lowers
+             *          its weight if list already has one.
+            */
+            static void lower(std::vector<WorkEdge> &list, uint32_t other, double weight, uint32_t middle)
+            {
+                for (WorkEdge &e : list)
+                {
+                    if (e.to == other)
+                    {
+                        if (weight < e.weight)
+                        {
+                            e.weight = weight;
+                            e.middle = middle;
+                        }
+                        return;
+                    }
+                }
+                WorkEdge e = { other, middle, weight };
+                list.push_back(e);
+            }
+
+            /** \brief  Adds the arc from from to to, or lowers its
+             *          weight if the arc already exists.
+            */
+            void addOrLower(uint32_t from, uint32_t to, double weight, uint32_t middle)
+            {
+                lower(out[from], to, weight, middle);
+                lower(in[to], from, weight, middle);
+            }
+
+            /** \brief  Dijkstra from src along out arcs that skips the
+             *          node being contracted and stops past limit or
+             *          after WITNESS_SETTLE_LIMIT nodes. Distances are
+             *          left in witnessDist until the next search.
+            */
+            void witnessSearch(uint32_t src, uint32_t skip, double limit)
+            {
+                for (uint32_t v : witnessTouched)
+                {
+                    witnessDist[v] = INF;
+                }
+                witnessTouched.clear();
+                MinQueue queue;
+                witnessDist[src] = 0;
+                witnessTouched.push_back(src);
+                queue.push(QueueItem(0, src));
+                unsigned settled = 0;
+                while (!queue.empty() && settled < WITNESS_SETTLE_LIMIT)
+                {
+                    QueueItem top = queue.top();
+                    queue.pop();
+                    if (top.first > witnessDist[top.second])
+                    {
+                        continue;
+                    }
+                    if (top.first > limit)
+                    {
+                        break;
+                    }
+                    settled++;
+                    for (const WorkEdge &e : out[top.second])
+                    {
+                        if (contracted[e.to] || e.to == skip)
+                        {
+                            continue;
+                        }
+                        double nd = top.first + e.weight;
+                        if (nd < witnessDist[e.to])
+                        {
+                            if (witnessDist[e.to] == INF)
+                            {
+                                witnessTouched.push_back(e.to);
+                            }
+                            witnessDist[e.to] = nd;
+                            queue.push(QueueItem(nd, e.to));
+                        }
+                    }
+                }
+            }
+
+            /** \brief  Finds the shortcuts contracting v would need,
+             *          one for each pair of an arc into v and an arc
+             *          out of it with no witness path around v. When
+             *          apply is set they are added to the graph.
+             *          Returns the number of shortcuts.
+            */
+            int contract(uint32_t v, bool apply)
+            {
+                std::vector<WorkEdge> sources, targets;
+                for (const WorkEdge &e : in[v])
+                {
+                    if (!contracted[e.to])
+                    {
+                        sources.push_back(e);
+                    }
+                }
+                for (const WorkEdge &e : out[v])
+                {
+                    if (!contracted[e.to])
+                    {
+                        targets.push_back(e);
+                    }
+                }
+                int shortcuts = 0;
+                for (const WorkEdge &source : sources)
+                {
+                    double maxVia = -1;
+                    for (const WorkEdge &target : targets)
+                    {
+                        if (target.to != source.to)
+                        {
+                            maxVia = std::max(maxVia, source.weight + target.weight);
+                        }
+                    }
+                    if (maxVia < 0)
+                    {
+                        continue;
+                    }
+                    witnessSearch(source.to, v, maxVia);
+                    for (const WorkEdge &target : targets)
+                    {
+                        double via = source.weight + target.weight;
+                        if (target.to != source.to && witnessDist[target.to] > via)
+                        {
+                            shortcuts++;
+                            if (apply)
+                            {
+                                addOrLower(source.to, target.to, via, v);
+                            }
+                        }
+                    }
+                }
+                return shortcuts;
+            }
+
+            /** \brief  Priority of v, lower is contracted first: the
+             *          edge difference plus the number of neighbors
+             *          already contracted, which spreads contraction
+             *          evenly over the map.
+            */
+            int priority(uint32_t v)
+            {
+                int degree = 0;
+                for (const WorkEdge &e : out[v])
+                {
+                    degree += contracted[e.to] ? 0 : 1;
+                }
+                for (const WorkEdge &e : in[v])
+                {
+                    degree += contracted[e.to] ? 0 : 1;
+                }
+                return contract(v, false) - degree + deletedNeighbors[v];
+            }
+    };
+
+    /** \brief  Copies the arcs of list that lead to higher ranked
+     *          nodes, in order of node index, as node v's entries
+     *          of an upward graph.
+    */
+    template <typename UpwardGraph>
+    void keepUpward(std::vector<WorkEdge> &list, uint32_t v, const std::vector<uint32_t> &rank, UpwardGraph &up)
+    {
+        std::sort(list.begin(), list.end(),
+            [](const WorkEdge &a, const WorkEdge &b) { return a.to < b.to; });
+        for (const WorkEdge &e : list)
+        {
+            if (rank[e.to] > rank[v])
+            {
+                up.targets.push_back(e.to);
+                up.weights.push_back(e.weight);
+                up.middle.push_back(e.middle);
+            }
+        }
+        up.offsets[v + 1] = static_cast<uint32_t>(up.targets.size());
+    }
+}
+
+/** \brief  Constructor for an empty hierarchy. Call build()
+ *          or load() before querying it.
+*/
+ContractionHierarchy::ContractionHierarchy()
+        :graphFingerprint(0)
+{
+}
+
+/** \brief  Contracts the nodes of g one at a time, lowest
+ *          priority first, adding a shortcut from an in
+ *          neighbor to an out neighbor whenever no witness path
+ *          is shorter than the path through the contracted
+ *          node. Arcs are weighted by the graph's profile, and
+ *          arcs the profile may not use are left out. Priorities are
+ *          updated lazily and ties go to the lower node index,
+ *          so building the same graph always gives the same
+ *          hierarchy. The result keeps only upward edges.
+ *
+ *          @return void
+*/
+void ContractionHierarchy::build(const Graph &g)
+{
+    uint32_t n = static_cast<uint32_t>(g.size());
+    Contractor work(g);
+    typedef std::pair<int, uint32_t> OrderItem;
+    std::priority_queue<OrderItem, std::vector<OrderItem>, std::greater<OrderItem>> order;
+    for (uint32_t v = 0; v < n; v++)
+    {
+        order.push(OrderItem(work.priority(v), v));
+    }
+    rank.assign(n, 0);
+    uint32_t next = 0;
+    while (!order.empty())
+    {
+        OrderItem top = order.top();
+        order.pop();
+        int current = work.priority(top.second);
+        if (!order.empty() && OrderItem(current, top.second) > order.top())
+        {
+            order.push(OrderItem(current, top.second));
+            continue;
+        }
+        work.contract(top.second, true);
+        work.contracted[top.second] = true;
+        rank[top.second] = next++;
+        for (const std::vector<WorkEdge> *list : { &work.out[top.second], &work.in[top.second] })
+        {
+            for (const WorkEdge &e : *list)
+            {
+                if (!work.contracted[e.to])
+                {
+                    work.deletedNeighbors[e.to]++;
+                }
+            }
+        }
+    }
+
+    for (int d = 0; d < 2; d++)
+    {
+        up[d] = UpwardGraph();
+        up[d].offsets.assign(n + 1, 0);
+    }
+    for (uint32_t v = 0; v < n; v++)
+    {
+        keepUpward(work.out[v], v, rank, up[0]);
+        keepUpward(work.in[v], v, rank, up[1]);
+    }
+    graphFingerprint = fingerprint(g);
+}
+
+/** \brief  Returns true once the hierarchy has been built
+ *          or loaded.
+ *
+ *          @return bool
+*/
+bool ContractionHierarchy::isBuilt() const
+{
+    return !up[0].offsets.empty();
+}
+
+/** \brief  Returns the number of nodes in the hierarchy.
+ *
+ *          @return size_t
+*/
+size_t ContractionHierarchy::size() const
+{
+    return rank.size();
+}
+
+/** \brief  Returns the number of upward arcs that are
+ *          shortcuts rather than arcs of the graph.
+ *
+ *          @return size_t
+*/
+size_t ContractionHierarchy::shortcutCount() const
+{
+    size_t count = 0;
+    for (const UpwardGraph &g : up)
+    {
+        count += g.middle.size() - std::count(g.middle.begin(), g.middle.end(), Graph::NO_NODE);
+    }
+    return count;
+}
+
+/** \brief  Writes the hierarchy to a binary file, tagged with
+ *          a fingerprint of the graph it belongs to.
+ *
+ *          @return bool true if the file was written
+*/
+bool ContractionHierarchy::save(const std::string &path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open() || !isBuilt())
+    {
+        return false;
+    }
+    FileHeader header = FileHeader();
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.nodes = static_cast<uint32_t>(rank.size());
+    header.edges[0] = static_cast<uint32_t>(up[0].targets.size());
+    header.edges[1] = static_cast<uint32_t>(up[1].targets.size());
+    header.reserved = 0;
+    header.graphFingerprint = graphFingerprint;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(rank.data()), rank.size() * sizeof(uint32_t));
+    for (const UpwardGraph &g : up)
+    {
+        out.write(reinterpret_cast<const char *>(g.offsets.data()), g.offsets.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char *>(g.targets.data()), g.targets.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char *>(g.weights.data()), g.weights.size() * sizeof(double));
+        out.write(reinterpret_cast<const char *>(g.middle.data()), g.middle.size() * sizeof(uint32_t));
+    }
+    return out.good();
+}
+
+/** \brief  Reads a hierarchy written by save(). The file is
+ *          rejected, leaving this hierarchy unchanged, if it
+ *          has the wrong format version, was built from a
+ *          different graph than g, is not exactly as long as
+ *          its header says, or fails the checks of
+ *          isConsistent, so a damaged file can never send a
+ *          query outside the arrays.
+ *
+ *          @return bool true if the hierarchy was loaded
+*/
+bool ContractionHierarchy::load(const std::string &path, const Graph &g)
+{
+    std::ifstream in(path, std::ios::binary);
+    FileHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != FORMAT_VERSION ||
+        header.nodes != g.size() || header.graphFingerprint != fingerprint(g))
+    {
+        return false;
+    }
+    //Check the length before sizing anything from the header
+    uint64_t expected = sizeof(header) + uint64_t(header.nodes) * sizeof(uint32_t);
+    for (int d = 0; d < 2; d++)
+    {
+        expected += (uint64_t(header.nodes) + 1) * sizeof(uint32_t) +
+                    uint64_t(header.edges[d]) * (2 * sizeof(uint32_t) + sizeof(double));
+    }
+    in.seekg(0, std::ios::end);
+    if (!in || static_cast<uint64_t>(in.tellg()) != expected)
+    {
+        return false;
+    }
+    in.seekg(sizeof(header));
+    std::vector<uint32_t> newRank(header.nodes);
+    UpwardGraph newUp[2];
+    in.read(reinterpret_cast<char *>(newRank.data()), newRank.size() * sizeof(uint32_t));
+    for (int d = 0; d < 2; d++)
+    {
+        UpwardGraph &g = newUp[d];
+        g.offsets.resize(header.nodes + 1);
+        g.targets.resize(header.edges[d]);
+        g.weights.resize(header.edges[d]);
+        g.middle.resize(header.edges[d]);
+        in.read(reinterpret_cast<char *>(g.offsets.data()), g.offsets.size() * sizeof(uint32_t));
+        in.read(reinterpret_cast<char *>(g.targets.data()), g.targets.size() * sizeof(uint32_t));
+        in.read(reinterpret_cast<char *>(g.weights.data()), g.weights.size() * sizeof(double));
+        in.read(reinterpret_cast<char *>(g.middle.data()), g.middle.size() * sizeof(uint32_t));
+        if (!in)
+        {
+            return false;
+        }
+    }
+    if (!isConsistent(newRank, newUp))
+    {
+        return false;
+    }
+    rank.swap(newRank);
+    std::swap(up[0], newUp[0]);
+    std::swap(up[1], newUp[1]);
+    graphFingerprint = header.graphFingerprint;
+    return true;
+}
+
+/** \brief  Checks what queries and unpackEdge rely on, for a
+ *          hierarchy read from a file: ranks is a permutation,
+ *          the offsets of both upward graphs start at 0, never
+ *          decrease and end at their arc count, the targets of
+ *          each node are sorted, distinct and ranked above it,
+ *          and every shortcut bypasses a node ranked below both
+ *          of its ends, so unpacking always terminates.
+ *
+ *          @return bool true if the hierarchy can be queried
+*/
+bool ContractionHierarchy::isConsistent(const std::vector<uint32_t> &ranks, const UpwardGraph upward[2])
+{
+    uint32_t n = static_cast<uint32_t>(ranks.size());
+    std::vector<bool> seen(n, false);
+    for (uint32_t r : ranks)
+    {
+        if (r >= n || seen[r])
+        {
+            return false;
+        }
+        seen[r] = true;
+    }
+    for (int d = 0; d < 2; d++)
+    {
+        const UpwardGraph &g = upward[d];
+        if (g.offsets.size() != size_t(n) + 1 || g.offsets[0] != 0 || g.offsets[n] != g.targets.size())
+        {
+            return false;
+        }
+        for (uint32_t v = 0; v < n; v++)
+        {
+            if (g.offsets[v] > g.offsets[v + 1])
+            {
+                return false;
+            }
+            for (uint32_t e = g.offsets[v]; e < g.offsets[v + 1]; e++)
+            {
+                uint32_t t = g.targets[e];
+                uint32_t m = g.middle[e];
+                if (t >= n || ranks[t] <= ranks[v] || (e > g.offsets[v] && g.targets[e - 1] >= t) ||
+                    (m != Graph::NO_NODE && (m >= n || ranks[m] >= ranks[v])))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/** \brief  Appends the nodes of the graph path represented by
+ *          the arc from a to b, leaving out a and ending with b.
+ *          Shortcuts are expanded recursively through the node
+ *          they bypass. An arc that is not in the hierarchy
+ *          means the path came from somewhere else, so nothing
+ *          more is appended.
+ *
+ *          @return bool false if some arc on the way is missing
+*/
+bool ContractionHierarchy::unpackEdge(uint32_t a, uint32_t b, std::vector<uint32_t> &out) const
+{
+    bool backward;
+    uint32_t e = findArc(a, b, backward);
+    if (e == Graph::NO_NODE)
+    {
+        return false;
+    }
+    uint32_t middle = up[backward].middle[e];
+    if (middle == Graph::NO_NODE)
+    {
+        out.push_back(b);
+        return true;
+    }
+    return unpackEdge(a, middle, out) && unpackEdge(middle, b, out);
+}
+
+/** \brief  Returns the index of the upward arc from a to b.
+ *          It is stored on the lower ranked of the two: in the
+ *          forward graph if that is a, else in the backward
+ *          graph, whose side is reported in backward.
+ *
+ *          @return uint32_t Graph::NO_NODE if there is no such arc
+*/
+uint32_t ContractionHierarchy::findArc(uint32_t a, uint32_t b, bool &backward) const
+{
+    backward = rank[a] > rank[b];
+    uint32_t low = backward ? b : a;
+    uint32_t high = backward ? a : b;
+    const UpwardGraph &g = up[backward];
+    std::vector<uint32_t>::const_iterator first = g.targets.begin() + g.offsets[low];
+    std::vector<uint32_t>::const_iterator last = g.targets.begin() + g.offsets[low + 1];
+    std::vector<uint32_t>::const_iterator it = std::lower_bound(first, last, high);
+    if (it == last || *it != high)
+    {
+        return Graph::NO_NODE;
+    }
+    return static_cast<uint32_t>(it - g.targets.begin());
+}
+
+/** \brief  FNV-1a hash over the node ids, arcs and arc
+ *          weights of a graph, used to match a saved hierarchy
+ *          to its graph and profile.
+ *
+ *          @return uint64_t
+*/
+uint64_t ContractionHierarchy::fingerprint(const Graph &g)
+{
+    uint64_t hash = 14695981039346656037ull;
+    const uint64_t PRIME = 1099511628211ull;
+    for (uint32_t i = 0; i < g.size(); i++)
+    {
+        hash = (hash ^ g.getID(i)) * PRIME;
+        for (uint32_t a = g.arcBegin(i); a < g.arcEnd(i); a++)
+        {
+            float weight = g.arcWeight(a);
+            uint32_t bits;
+            std::memcpy(&bits, &weight, sizeof(bits));
+            hash = (hash ^ g.arcTarget(a)) * PRIME;
+            hash = (hash ^ bits) * PRIME;
+        }
+    }
+    return hash;
+}
@@ -0,0 +1,55 @@
+/**
+ * @brief ContractionHierarchy Class header
+ */
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "graph.hpp"
+
+class ContractionHierarchy {
+    private:
+        // Arcs between a node and higher ranked nodes, in CSR layout
+        struct UpwardGraph {
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> targets;
+            std::vector<double> weights;
+            // Node a shortcut bypasses, or Graph::NO_NODE for an arc of the graph
+            std::vector<uint32_t> middle;
+        };
+        // Position of each node in the contraction order
+        std::vector<uint32_t> rank;
+        // up[0] holds the arcs from node i to higher ranked nodes, for the
+        // forward search. up[1] holds the arcs into node i from higher ranked
+        // nodes, stored by their source, for the backward search.
+        UpwardGraph up[2];
+        // Identifies the graph and profile the hierarchy was built from
+        uint64_t graphFingerprint;
+
+        static uint64_t fingerprint(const Graph &g);
+        static bool isConsistent(const std::vector<uint32_t> &ranks, const UpwardGraph upward[2]);
+        uint32_t findArc(uint32_t a, uint32_t b, bool &backward) const;
+
+    public:
+        ContractionHierarchy();
+        // Contracts every node of g and stores the resulting upward graphs
+        void build(const Graph &g);
+        bool isBuilt() const;
+        bool save(const std::string &path) const;
+        bool load(const std::string &path, const Graph &g);
+        size_t size() const;
+        size_t shortcutCount() const;
+        uint32_t getRank(uint32_t i) const { return rank[i]; }
+        // Upward arcs of node i for the forward search, or the backward one
+        uint32_t upBegin(uint32_t i, bool backward) const { return up[backward].offsets[i]; }
+        uint32_t upEnd(uint32_t i, bool backward) const { return up[backward].offsets[i + 1]; }
+        uint32_t upTarget(uint32_t e, bool backward) const { return up[backward].targets[e]; }
+        double upWeight(uint32_t e, bool backward) const { return up[backward].weights[e]; }
+        // Appends the graph nodes after a on the arc from a to b, ending with b;
+        // false if the hierarchy has no such arc
+        bool unpackEdge(uint32_t a, uint32_t b, std::vector<uint32_t> &out) const;
+};
+
+#endif
@@ -0,0 +1,218 @@
+/**
+ * @brief IdCollector Class implementation
+ */
+
+#include "idcollector.hpp"
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+namespace {
+    // Ids read from a run per refill during the merge
+    const size_t READ_BLOCK = 4096;
+}
+
+/** \brief  Reads the next block of a spilled run. The reader
+ *          of the buffer has no file and is never refilled.
+ *
+ *          @return bool false at the end of the run or on a read error
+*/
+bool IdCollector::RunReader::refill()
+{
+    if (file == nullptr)
+    {
+        return false;
+    }
+    block.resize(READ_BLOCK);
+    block.resize(std::fread(block.data(), sizeof(uint64_t), READ_BLOCK, file));
+    pos = 0;
+    return !block.empty();
+}
+
+/** \brief  Constructor that sizes the in-memory buffer from
+ *          the budget, holding at least a few thousand ids so
+ *          a tiny budget does not spill on every add.
+*/
+IdCollector::IdCollector(size_t memoryBudget)
+        :bufferLimit(std::max<size_t>(memoryBudget / sizeof(uint64_t), READ_BLOCK)), current(0), lastLookup(0),
+         atEnd(true), failed(false)
+{
+}
+
+/** \brief  Destructor that closes, and so deletes, every
+ *          spilled run.
+*/
+IdCollector::~IdCollector()
+{
+    for (std::FILE *run : runs)
+    {
+        std::fclose(run);
+    }
+}
+
+/** \brief  Adds an id, which may repeat. When the buffer is
+ *          full it is sorted and spilled to a temporary file.
+ *
+ *          @return void
+*/
+void IdCollector::add(uint64_t id)
+{
+    buffer.push_back(id);
+    if (buffer.size() >= bufferLimit)
+    {
+        spill();
+    }
+}
+
+/** \brief  Returns the number of runs spilled to disk so far.
+ *
+ *          @return size_t
+*/
+size_t IdCollector::runCount() const
+{
+    return runs.size();
+}
+
+/** \brief  Sorts and dedupes the buffer, then writes it to a
+ *          new temporary file that is removed when closed.
+ *          Deduping first keeps runs short when the same ids
+ *          are added over and over. If the run cannot be
+ *          written the ids stay in memory, so nothing is lost
+ *          and only the budget is exceeded.
+ *
+ *          @return void
+*/
+void IdCollector::spill()
+{
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+    std::FILE *run = std::tmpfile();
+    if (run == nullptr)
+    {
+        bufferLimit = std::max(bufferLimit, buffer.size() * 2);
+        return;
+    }
+    if (std::fwrite(buffer.data(), sizeof(uint64_t), buffer.size(), run) != buffer.size() ||
+        std::fflush(run) != 0)
+    {
+        std::fclose(run);
+        bufferLimit = std::max(bufferLimit, buffer.size() * 2);
+        return;
+    }
+    std::rewind(run);
+    runs.push_back(run);
+    buffer.clear();
+}
+
+/** \brief  Ends adding. The buffer is sorted and kept in
+ *          memory as the last run, and a k-way merge over all
+ *          the runs is started. Only one block of each spilled
+ *          run is in memory at a time, so the merged set is
+ *          never resident.
+ *
+ *          @return bool false if a run could not be read back
+*/
+bool IdCollector::finish()
+{
+    std::sort(buffer.begin(), buffer.end());
+    buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+    readers.resize(runs.size() + 1);
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        readers[i].file = runs[i];
+        readers[i].pos = 0;
+    }
+    RunReader &memory = readers.back();
+    memory.file = nullptr;
+    memory.block.swap(buffer);
+    memory.pos = 0;
+    std::vector<uint64_t>().swap(buffer);
+    heads.reserve(readers.size());
+    restart();
+    return !failed;
+}
+
+/** \brief  Rewinds every run and fills the heap with their
+ *          first ids, then moves to the smallest.
+ *
+ *          @return void
+*/
+void IdCollector::restart()
+{
+    heads.clear();
+    for (size_t i = 0; i < readers.size(); i++)
+    {
+        RunReader &reader = readers[i];
+        if (reader.file != nullptr)
+        {
+            if (std::fseek(reader.file, 0, SEEK_SET) != 0)
+            {
+                failed = true;
+                continue;
+            }
+            reader.refill();
+            failed = failed || std::ferror(reader.file);
+        }
+        reader.pos = 0;
+        if (!reader.block.empty())
+        {
+            heads.push_back(Head(reader.block[0], i));
+            std::push_heap(heads.begin(), heads.end(), std::greater<Head>());
+        }
+    }
+    lastLookup = 0;
+    atEnd = false;
+    advance();
+}
+
+/** \brief  Takes the smallest head off the heap as the new
+ *          current id, along with the heads of other runs that
+ *          hold the same id, and pushes the next id of each of
+ *          those runs.
+ *
+ *          @return void
+*/
+void IdCollector::advance()
+{
+    if (heads.empty())
+    {
+        atEnd = true;
+        return;
+    }
+    current = heads.front().first;
+    while (!heads.empty() && heads.front().first == current)
+    {
+        size_t r = heads.front().second;
+        std::pop_heap(heads.begin(), heads.end(), std::greater<Head>());
+        heads.pop_back();
+        RunReader &reader = readers[r];
+        if (++reader.pos == reader.block.size() && !reader.refill())
+        {
+            failed = failed || (reader.file != nullptr && std::ferror(reader.file));
+            continue;
+        }
+        heads.push_back(Head(reader.block[reader.pos], r));
+        std::push_heap(heads.begin(), heads.end(), std::greater<Head>());
+    }
+}
+
+/** \brief  Looks an id up in the merge, advancing it past
+ *          every smaller id. Ids are best looked up in
+ *          increasing order, as nodes come in most files;
+ *          going back starts the merge over.
+ *
+ *          @return bool true if the id was added, or if a run failed to read back
+*/
+bool IdCollector::contains(uint64_t id)
+{
+    if (id < lastLookup)
+    {
+        restart();
+    }
+    lastLookup = id;
+    while (!atEnd && current < id)
+    {
+        advance();
+    }
+    return failed || (!atEnd && current == id);
+}
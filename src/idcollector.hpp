@@ -0,0 +1,66 @@
+/**
+ * @brief IdCollector Class header
+ */
+#ifndef IDCOLLECTOR_H
+#define IDCOLLECTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+// Collects a set of ids too big to hold in memory, such as the node refs
+// of every highway, in sorted runs spilled to disk, and answers lookups
+// by merging the runs as it goes, so the whole set is never resident.
+class IdCollector {
+    private:
+        // Buffered reader over one sorted run, or over the sorted buffer
+        // when file is null
+        struct RunReader {
+            std::FILE *file;
+            std::vector<uint64_t> block;
+            size_t pos;
+            bool refill();
+        };
+        // Next id of a run and the run's reader
+        typedef std::pair<uint64_t, size_t> Head;
+
+        // Ids added since the last spill, unsorted
+        std::vector<uint64_t> buffer;
+        size_t bufferLimit;
+        // Sorted runs of distinct ids spilled to temporary files
+        std::vector<std::FILE *> runs;
+        // Merge of the runs after finish(): a min-heap of their heads, the
+        // smallest id not yet passed, and the last id looked up
+        std::vector<RunReader> readers;
+        std::vector<Head> heads;
+        uint64_t current, lastLookup;
+        bool atEnd, failed;
+
+        //Sorts and dedupes the buffer and writes it out as a run
+        void spill();
+        //Starts the merge over from the smallest id
+        void restart();
+        //Moves current to the next distinct id of the merge
+        void advance();
+
+    public:
+        // Keeps at most memoryBudget bytes of ids in memory before spilling
+        IdCollector(size_t memoryBudget);
+        ~IdCollector();
+        IdCollector(const IdCollector &) = delete;
+        IdCollector& operator=(const IdCollector &) = delete;
+        void add(uint64_t id);
+        // Number of runs spilled to disk so far
+        size_t runCount() const;
+        // Ends adding and starts the merge, false if a run cannot be read
+        bool finish();
+        // True if id was added. Lookups in increasing id order read every
+        // run once; a smaller id than the last starts the merge over. Once
+        // a run fails to read back every id counts as added, so a caller
+        // that keeps what was added never loses any of it.
+        bool contains(uint64_t id);
+};
+
+#endif
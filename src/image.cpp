@@ -6,72 +6,135 @@
 #include <fstream>
 #include <iomanip>
 #include <math.h>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <cstdio>
+#include <cerrno>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "image.hpp"
+#include "threadpool.hpp"
+#include "metrics.hpp"
 
 /** \brief  Constructor for initializing and empty
  *          white canvas when there are no parameters
  *          included in the function call 
  *
 */
-Image::Image() {
+Image::Image()
+        :fitted(false), projectedVersion(0), pool(nullptr)
+{
     // initialize empty canvas
-    numRows = 5000;
-    numColumns = 5000;
-    minLat = 0; maxLat = 0; minLon = 0; maxLon = 0;
-    m = new int*[numRows];
-    for (unsigned i = 0; i < numRows; i++)
-    {
-        m[i] = new int[numColumns];
-        for (unsigned j = 0; j < numColumns; j++)
-        {
-            m[i][j] = 255;
-        }
-    }
+    this->allocate(5000, 5000);
 }
 
-/** \brief  Gets and intializes all max
- *          values for matrix bounds and
- *          matrix elements. Sets greyscale
- *          values to 255 (white)
+/** \brief  Fits the map bounds onto an r by c canvas
+ *          with the given projection, projects every node
+ *          once and draws all nodes and edges of the map.
+ *          Greyscale values start at 255 (white).
  *                     
 */
-Image::Image(Osm &osm, unsigned r, unsigned c) 
-{ 
-    this->minLat = osm.get_MIN_LAT();
-    this->maxLat = osm.get_MAX_LAT();
-    this->minLon = osm.get_MIN_LON();
-    this->maxLon = osm.get_MAX_LON();
+Image::Image(Osm &osm, unsigned r, unsigned c, Projection::Type projectionType, ThreadPool *workers)
+        :Image(*osm.snapshot(), r, c, projectionType, workers)
+{
+}
+
+/** \brief  Draws one version of a map, as the constructor
+ *          taking an Osm does with the current one. The map
+ *          is only read while the image is drawn.
+*/
+Image::Image(const MapState &map, unsigned r, unsigned c, Projection::Type projectionType, ThreadPool *workers)
+        :projection(projectionType, map.bounds.minLat, map.bounds.minLon, map.bounds.maxLat, map.bounds.maxLon, r, c),
+         fitted(true), projectedVersion(0), pool(workers)
+{
     // initialize internal matrix
-    numRows = r;
-    numColumns = c;
-    m = new int*[numRows];
-    for (unsigned i = 0; i < numRows; i++)
-    {
-        m[i] = new int[numColumns];
-        for (unsigned j = 0; j < numColumns; j++)
-        {
-            m[i][j] = 255;
-        }
-    }
+    this->allocate(r, c);
+    this->projectNodes(map);
     //Calls drawNodes and drawEdges to draw all nodes/edges in map into matrix
-    this->drawNodes(osm);
-    this->drawEdges(osm);
+    this->drawNodes(map.graph);
+    this->drawEdges(map.graph);
+}
+
+/** \brief  Constructor for a blank white canvas that
+ *          is drawn on from pixel coordinates, with no map
+ *          bounds.
+*/
+Image::Image(unsigned r, unsigned c, ThreadPool *workers)
+        :fitted(false), projectedVersion(0), pool(workers)
+{
+    this->allocate(r, c);
 }
 
 /** \brief  The destructor for Image class which deallocates
  * 	    all allocated data in constructors. 	     
  */
 Image::~Image() {
-    if (m != nullptr)
+    std::free(pixels);
+    pixels = nullptr;
+}
+
+/** \brief  Allocates the canvas as one contiguous, cache line
+ *          aligned block of 8-bit pixels and fills it with
+ *          white. Each row is padded to a multiple of the
+ *          alignment so every row starts aligned as well.
+ *
+ *          @return void
+ */
+void Image::allocate(unsigned r, unsigned c)
+{
+    const size_t ALIGNMENT = 64;
+    numRows = r;
+    numColumns = c;
+    stride = (static_cast<size_t>(c) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    void *block = nullptr;
+    size_t bytes = std::max<size_t>(stride * numRows, ALIGNMENT);
+    if (posix_memalign(&block, ALIGNMENT, bytes) != 0)
     {
-        for (unsigned i = 0; i < numRows; i++)
+        throw std::bad_alloc();
+    }
+    pixels = static_cast<uint8_t *>(block);
+    std::memset(pixels, 255, bytes);
+}
+
+/** \brief  Paints every pixel white, so a canvas can be
+ *          reused without allocating it again.
+ *
+ *          @return void
+ */
+void Image::clear()
+{
+    std::memset(pixels, 255, stride * numRows);
+}
+
+/** \brief  Tells if nothing has been drawn since the canvas
+ *          was allocated or cleared.
+ *
+ *          @return bool true if every pixel is white
+ */
+bool Image::isBlank() const
+{
+    for (unsigned i = 0; i < numRows; i++)
+    {
+        const uint8_t *row = pixels + i * stride;
+        if (std::find_if(row, row + numColumns, [](uint8_t p) { return p != 255; }) != row + numColumns)
         {
-            delete[] m[i];
-            m[i] = nullptr;
+            return false;
         }
-        delete[] m;
-        m = nullptr;
     }
+    return true;
+}
+
+/** \brief  Draws a line from (r1,c1) to (r2,c2) in grey
+ *          value v. Pixels off the canvas are clipped.
+ *
+ *          @return void
+ */
+void Image::drawSegment(int r1, int c1, int r2, int c2, int ra, int v)
+{
+    this->drawLine(r1, c1, r2, c2, ra, v, 0, static_cast<int>(numRows));
 }
 
 /** \brief  This function takes in the beginning and ending
@@ -81,152 +144,393 @@ Image::~Image() {
 */
 void Image::drawRoute(const std::vector<OsmNode> &route) 
 {
-    int count = 1;
-    OsmNode prev, curr;
-    for(auto it = route.begin(); it != route.end(); ++it, ++count)
+    std::pair<int,int> prevLoc;
+    for (size_t i = 0; i < route.size(); i++)
     {
-        curr = *it;
-        auto currLoc = getMatrixCoord(curr);
+        std::pair<int,int> currLoc = getMatrixCoord(route[i]);
         this->shadeNode(currLoc.first, currLoc.second , 8, 50);
-        if (count > 1)
+        if (i > 0)
         {
-            auto prevLoc = getMatrixCoord(prev);
-            auto edgeCoords = getEdgeCoords(currLoc, prevLoc);
-            for (std::pair<int,int> i : edgeCoords)
+            this->drawLine(currLoc.first, currLoc.second, prevLoc.first, prevLoc.second,
+                           4, 50, 0, static_cast<int>(numRows));
+        }
+        prevLoc = currLoc;
+    }
+}
+
+namespace {
+    /** \brief  Writes all of [data, data + size) to fd, retrying
+     *          short writes.
+     *
+     *          @return bool
+     */
+    bool writeAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0)
             {
-                this->shadeNode(i.first, i.second , 4, 50);
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
             }
+            data += n;
+            size -= static_cast<size_t>(n);
         }
-        prev = curr;
+        return true;
     }
 }
 
 /** \brief  Saves the bitmap into pgm format
  *          after the matrix is developed and
  *          saves them with their given file name.
+ *          PGM_BINARY writes a P5 file straight from
+ *          the pixel buffer, PGM_ASCII writes the
+ *          older and larger P2 text format.
  *               
 */
-void Image::saveImage(const std::string& pgmPath) const 
+void Image::saveImage(const std::string& pgmPath, Format format) const 
+{
+    METRICS_PHASE(SAVE_IMAGE);
+    int fd = ::open(pgmPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0)
+    {
+        this->writeImage(fd, format);
+        ::close(fd);
+    }
+}
+
+/** \brief  Writes the image in the given PGM format to fd,
+ *          starting at its current offset, so several images
+ *          can be written into one file.
+ *
+ *          @return bool false if a write failed
+ */
+bool Image::writeImage(int fd, Format format) const
+{
+    return (format == PGM_BINARY) ? this->writeBinary(fd) : this->writeAscii(fd);
+}
+
+/** \brief  Writes the P5 header and then the pixel rows
+ *          with writev, gathering many rows per call so
+ *          the rows go to the file without being copied.
+ *
+ *          @return bool
+ */
+bool Image::writeBinary(int fd) const
 {
-    const int MAX_PGM_GREY = 255; 
-    std::ofstream pgmStream(pgmPath);
-    if (pgmStream.is_open())
+    const int MAX_PGM_GREY = 255;
+    std::string header = "P5\n# comments line\n" + std::to_string(numColumns) + " " +
+                         std::to_string(numRows) + "\n" + std::to_string(MAX_PGM_GREY) + "\n";
+    if (!writeAll(fd, header.data(), header.size()))
     {
-        //Writes first 3 Lines --P2 ----Comments---Rows,Columns-----
-        pgmStream << "P2" << "\n" << "# comments line" << "\n" << numColumns <<
-        " " << numRows << "\n" << MAX_PGM_GREY << "\n";
-            //Loops through the matrix and writes it to 
-            //the file in general matrix form. 
-        for (size_t i = 0; i < numRows; i++)
+        return false;
+    }
+    if (stride == numColumns)
+    {
+        return writeAll(fd, reinterpret_cast<const char *>(pixels), stride * numRows);
+    }
+    const unsigned ROWS_PER_CALL = 512;
+    struct iovec rows[ROWS_PER_CALL];
+    for (unsigned first = 0; first < numRows; first += ROWS_PER_CALL)
+    {
+        unsigned count = std::min(ROWS_PER_CALL, numRows - first);
+        size_t total = 0;
+        for (unsigned i = 0; i < count; i++)
+        {
+            rows[i].iov_base = pixels + (first + i) * stride;
+            rows[i].iov_len = numColumns;
+            total += numColumns;
+        }
+        ssize_t n = ::writev(fd, rows, count);
+        if (n < 0 && errno != EINTR)
         {
-            if (i > 0)
+            return false;
+        }
+        //Finish a short write row by row
+        size_t done = (n < 0) ? 0 : static_cast<size_t>(n);
+        if (done < total)
+        {
+            for (unsigned i = 0; i < count; i++)
             {
-                pgmStream << "\n";
-            }
-            for (size_t j = 0; j < numColumns; j++)
-            {     
-                    if (j > 0)
-                    {
-                            pgmStream << " ";
-                    }
-                    pgmStream << m[i][j];
+                size_t rowDone = std::min<size_t>(done, numColumns);
+                done -= rowDone;
+                if (!writeAll(fd, static_cast<const char *>(rows[i].iov_base) + rowDone, numColumns - rowDone))
+                {
+                    return false;
+                }
             }
         }
-        pgmStream << "\r\n";
-        pgmStream.close();  
     }
+    return true;
 }
 
-/** \brief  Converts the latitudes to fit
- *          the given bounds of the bitmap              
-*/
-double Image::convertLat(double uLat) const
+/** \brief  Writes the P2 header and pixel values as text.
+ *          Each value's digits come from a lookup table and
+ *          the text is collected in a large buffer that is
+ *          written in a few calls.
+ *
+ *          @return bool
+ */
+bool Image::writeAscii(int fd) const
 {
-    double retVal, top, bot;
-    top = uLat-minLat;
-    bot = maxLat-minLat;
-    retVal = (this->numRows-1)*(top/bot);
-    return retVal;
+    const int MAX_PGM_GREY = 255;
+    const size_t FLUSH_SIZE = 1 << 20;
+    char digits[256][4];
+    unsigned char lengths[256];
+    for (int v = 0; v < 256; v++)
+    {
+        lengths[v] = static_cast<unsigned char>(std::snprintf(digits[v], sizeof(digits[v]), "%d", v));
+    }
+    //Writes first 3 Lines --P2 ----Comments---Rows,Columns-----
+    std::string buffer = "P2\n# comments line\n" + std::to_string(numColumns) + " " +
+                         std::to_string(numRows) + "\n" + std::to_string(MAX_PGM_GREY) + "\n";
+    buffer.reserve(FLUSH_SIZE + 4 * static_cast<size_t>(numColumns) + 2);
+    for (size_t i = 0; i < numRows; i++)
+    {
+        if (i > 0)
+        {
+            buffer.push_back('\n');
+        }
+        const uint8_t *row = pixels + i * stride;
+        for (size_t j = 0; j < numColumns; j++)
+        {
+            if (j > 0)
+            {
+                buffer.push_back(' ');
+            }
+            buffer.append(digits[row[j]], lengths[row[j]]);
+        }
+        if (buffer.size() >= FLUSH_SIZE)
+        {
+            if (!writeAll(fd, buffer.data(), buffer.size()))
+            {
+                return false;
+            }
+            buffer.clear();
+        }
+    }
+    buffer.append("\r\n");
+    return writeAll(fd, buffer.data(), buffer.size());
 }
 
-/** \brief  Converts the longitude to fit
- *          the given bounds of the bitmap            
+/** \brief  Computes the pixel position of every node of
+ *          the map, so drawing only reads integers. Nothing is
+ *          done if they are already known for this version. A
+ *          canvas with no projection yet is fitted to the map
+ *          bounds first, as the map constructors do.
+ *
+ *          @return void
 */
-double Image::convertLon(double uLon) const
+void Image::projectNodes(const MapState &map)
 {
-    double retVal, top, bot;
-    top = uLon-minLon;
-    bot = maxLon-minLon;
-    retVal = (this->numRows-1)*(top/bot);
-    return retVal;
+    if (!fitted)
+    {
+        projection = Projection(Projection::EQUIRECTANGULAR, map.bounds.minLat, map.bounds.minLon,
+                                map.bounds.maxLat, map.bounds.maxLon, numRows, numColumns);
+        fitted = true;
+    }
+    if (projectedVersion != map.version || map.version == 0)
+    {
+        projection.project(map.graph, nodeRows, nodeColumns);
+        projectedVersion = map.version;
+    }
 }
 
 /** \brief  Initializer function to be called in constructor,
- * 	        given an Osm object, it will loop through an 
- * 	        unordered_map of nodes and draw them to the canvas
- *  	    of the current Image object.
+ * 	        given a map graph, it will loop through its
+ * 	        nodes and draw every node with an edge to the
+ *  	    canvas of the current Image object.
  *
  *      @return void
  */
-void Image::drawNodes(Osm &osm)
+void Image::drawNodes(const Graph &g)
 {
     const unsigned NON_ROUTE_ROADS = 180;
-    std::unordered_map<std::string, OsmNode> osmNodes;
-    std::unordered_map<std::string, std::vector<OsmNode>> osmAdjList;
-    osm.popNodeMap(osmNodes);
-    osm.popAdjList(osmAdjList);
-    for(auto it = osmNodes.begin(); it != osmNodes.end(); ++it)
+    for (NodeView node : NodeRange(g))
     {
-        if(osmAdjList[it->first].begin() != osmAdjList[it->first].end())
+        if (node.degree() > 0)
         {
-            double row, col;
-            row = convertLon((it->second.getLon()));
-            col = convertLat((it->second.getLat()));
-            this->shadeNode(row, col, 4, NON_ROUTE_ROADS);
+            this->shadeNode(nodeRows[node.index()], nodeColumns[node.index()], 4, NON_ROUTE_ROADS);
         }
     }
 }
 
-/** \brief  This function, provided on Osm object, will
- *	        loop through an Osm objects ajacency map and
- *	        and draw the lines between each node and its 
- * 	        adjacent nodes.
+/** \brief  This function, provided a map graph, will
+ *	        loop through its nodes and draw the line of
+ *	        every edge once, no matter how many of its
+ *	        endpoints list it.
  * 	     
  *           @return void
  */
-void Image::drawEdges(Osm &osm)
+void Image::drawEdges(const Graph &g)
 {
-    const unsigned NON_ROUTE_ROADS = 180;
-    std::unordered_map<std::string, std::vector<OsmNode>> osmAdjList;
-    std::unordered_map<std::string, OsmNode> osmNodes;
-    osm.popNodeMap(osmNodes);
-    osm.popAdjList(osmAdjList);
-    
-    for(auto it = osmAdjList.begin(); it != osmAdjList.end(); ++it)
+    METRICS_PHASE(DRAW_EDGES);
+    const uint8_t NON_ROUTE_ROADS = 180;
+    const int RADIUS = 2;
+    //Pixel endpoints of every undirected edge
+    std::vector<Stroke> strokes;
+    for (NodeView node : NodeRange(g))
     {
-        //for each node in adjList plot EdgeCoords of that node and each
-        // node in its list in matrix.
-        std::vector<std::pair<int,int>> edgeCoords;
-        OsmNode currNode = osmNodes[it->first]; 
-        for (OsmNode i : it->second)
+        uint32_t u = node.index();
+        for (uint32_t v : node.neighbors().indices())
         {
-            std::pair<int,int> src = this->getMatrixCoord(currNode);
-            std::pair<int,int> dest = this->getMatrixCoord(i);
-            edgeCoords = getEdgeCoords(src, dest);
-            for (std::pair<int,int> i : edgeCoords)
+            if (v >= u)
             {
-                //this->shadeNode(i.first, i.second, 1, NON_ROUTE_ROADS)
-                //std::cout << i.first <<" _____ "<< i.second <<std::endl;
-                this->shadeNode(i.first, i.second , 2, NON_ROUTE_ROADS);
+                Stroke s = { nodeRows[u], nodeColumns[u], nodeRows[v], nodeColumns[v], NON_ROUTE_ROADS };
+                strokes.push_back(s);
             }
         }
     }
+    this->drawStrokes(strokes, RADIUS);
 }
 
-/** \brief  Private function that takes int two pairs
- *	        of coordinates (x,y),and (x,y) as pair<int,int>
- *	        and will return a vector of (x,y) coordinates representing
- * 	        the line connecting the provided coordinates.
+/** \brief  Shades the isochrone on the current version of
+ *          the map, as the MapState overload does.
+ *
+ *          @return bool false if it was searched on another version
+ */
+bool Image::drawIsochrone(Osm &osm, const Isochrone &reached)
+{
+    return this->drawIsochrone(*osm.snapshot(), reached);
+}
+
+/** \brief  Shades what an isochrone reached on top of the
+ *          map: every edge whose two ends were reached, and
+ *          every reached node, with a greyscale ramp from
+ *          black at the source to light grey at the budget.
+ *          Strokes are drawn from the most to the least
+ *          costly, so the cheaper side of a boundary wins
+ *          where strokes overlap. The isochrone must come
+ *          from this version of the map, since its nodes are
+ *          indices into the map's graph.
+ *
+ *          @return bool false if it was searched on another version
+ */
+bool Image::drawIsochrone(const MapState &map, const Isochrone &reached)
+{
+    const int RADIUS = 4;
+    const double LIGHTEST = 150;
+    const Graph &g = map.graph;
+    if (reached.version != map.version)
+    {
+        return false;
+    }
+    if (reached.nodes.empty())
+    {
+        return true;
+    }
+    this->projectNodes(map);
+    std::vector<double> cost(g.size(), std::numeric_limits<double>::infinity());
+    for (size_t i = 0; i < reached.nodes.size(); i++)
+    {
+        cost[reached.nodes[i]] = reached.costs[i];
+    }
+    double scale = (reached.budget > 0 && reached.budget < std::numeric_limits<double>::infinity()) ?
+                   LIGHTEST / reached.budget : 0;
+    if (scale == 0)
+    {
+        //No usable budget, so ramp over the costliest node reached instead
+        double most = reached.costs.back();
+        scale = (most > 0) ? LIGHTEST / most : 0;
+    }
+    std::vector<Stroke> strokes;
+    for (uint32_t u : reached.nodes)
+    {
+        int r = nodeRows[u];
+        int c = nodeColumns[u];
+        Stroke node = { r, c, r, c, static_cast<uint8_t>(std::min(cost[u] * scale, LIGHTEST)) };
+        strokes.push_back(node);
+        for (uint32_t v : g.neighbors(u))
+        {
+            if (v > u && cost[v] < std::numeric_limits<double>::infinity())
+            {
+                Stroke edge = { r, c, nodeRows[v], nodeColumns[v],
+                                static_cast<uint8_t>(std::min(std::max(cost[u], cost[v]) * scale, LIGHTEST)) };
+                strokes.push_back(edge);
+            }
+        }
+    }
+    std::stable_sort(strokes.begin(), strokes.end(), [](const Stroke &a, const Stroke &b) {
+        return a.value > b.value;
+    });
+    this->drawStrokes(strokes, RADIUS);
+    return true;
+}
+
+/** \brief  Returns the workers strokes are drawn on: those
+ *          passed to the constructor, or a pool of one thread
+ *          per core that is started on the first call and then
+ *          kept for the life of the image.
+ *
+ *          @return ThreadPool &
+ */
+ThreadPool &Image::strokePool()
+{
+    if (pool == nullptr)
+    {
+        ownPool.reset(new ThreadPool());
+        pool = ownPool.get();
+    }
+    return *pool;
+}
+
+/** \brief  Draws every stroke with a brush of size ra, in
+ *          order.
+ *
+ *	        The rows of the canvas are split into bands
+ *	        and each stroke is binned into the bands it
+ *	        touches. Bands are then drawn in parallel, each
+ *	        clipping its strokes to its own rows, so no two
+ *	        threads write the same pixel and the result
+ *	        matches drawing serially.
+ *
+ *          @return void
+ */
+void Image::drawStrokes(const std::vector<Stroke> &strokes, int ra)
+{
+    if (strokes.empty() || numRows == 0)
+    {
+        return;
+    }
+    ThreadPool &workers = strokePool();
+    unsigned numBands = std::min(numRows, workers.size() * 4);
+    unsigned bandRows = (numRows + numBands - 1) / numBands;
+    std::vector<std::vector<uint32_t>> bands(numBands);
+    for (uint32_t e = 0; e < strokes.size(); e++)
+    {
+        //Rows this stroke can reach
+        int top = std::min(strokes[e].r1, strokes[e].r2) - ra / 2;
+        int bottom = std::max(strokes[e].r1, strokes[e].r2) - ra / 2 + ra;
+        if (bottom < 0 || top >= static_cast<int>(numRows))
+        {
+            continue;
+        }
+        unsigned first = std::max(top, 0) / bandRows;
+        unsigned last = std::min(bottom, static_cast<int>(numRows) - 1) / bandRows;
+        for (unsigned b = first; b <= last; b++)
+        {
+            bands[b].push_back(e);
+        }
+    }
+    workers.parallelFor(numBands, [&](unsigned, size_t b) {
+        int rowBegin = static_cast<int>(b * bandRows);
+        int rowEnd = std::min(rowBegin + static_cast<int>(bandRows), static_cast<int>(numRows));
+        for (uint32_t e : bands[b])
+        {
+            const Stroke &s = strokes[e];
+            this->drawLine(s.r1, s.c1, s.r2, s.c2, ra, s.value, rowBegin, rowEnd);
+        }
+    });
+}
+
+/** \brief  Private function that draws the line between
+ *	        (r1,c1) and (r2,c2) straight into the canvas with
+ *	        a square brush of size ra, writing only rows in
+ *	        [rowBegin, rowEnd).
  *
  *	        This function uses Bresenham's line drawing
  * 	        algorithm to loop through values while taking
@@ -234,68 +538,112 @@ void Image::drawEdges(Osm &osm)
  *	        is travelling and a range for error 
  *	        (Incrementing as the error changes.)
  *
- *       @return std::vector<std::pair<int,int>>
+ *	        Instead of stamping the brush on every point,
+ *	        consecutive points that share a row or column
+ *	        are merged into a run, and the brush over a run
+ *	        is one rectangle filled with a memset per row.
+ *	        The stroke's bounding box is clipped against the
+ *	        canvas once: strokes fully outside are skipped
+ *	        and strokes fully inside are drawn without any
+ *	        bounds checks.
+ *
+ *       @return void
  */
-std::vector<std::pair<int,int>> Image::getEdgeCoords(std::pair<int,int> src ,std::pair<int,int> dest)
+void Image::drawLine(int r1, int c1, int r2, int c2, int ra, int v, int rowBegin, int rowEnd)
 {
-    //Fuinction should return a vector of pairs<int,int> representing
-    // coordinates in the matrix that is along an edge (or line).
-    //y = mx + b ; x = (y-b)/m ;
-    std::vector<std::pair<int,int>> edgeNodes; 
-    int x1=src.first, y1=src.second, x2=dest.first, y2=dest.second;
-    int x1_Or = x1, x2_Or = x2, y1_Or = y1, y2_Or = y2;
-    //Will make sure values used are arranged properly to handle all cases
-    if(fabs(y2 - y1) > fabs(x2 - x1))
+    int half = ra / 2;
+    int top = std::max(rowBegin, 0);
+    int bottom = std::min(rowEnd, static_cast<int>(numRows)) - 1;
+    int right = static_cast<int>(numColumns) - 1;
+    int strokeTop = std::min(r1, r2) - half, strokeBottom = std::max(r1, r2) - half + ra;
+    int strokeLeft = std::min(c1, c2) - half, strokeRight = std::max(c1, c2) - half + ra;
+    if (strokeBottom < top || strokeTop > bottom || strokeRight < 0 || strokeLeft > right)
     {
-        std::swap(x1, y1);
-        std::swap(x2, y2);
+        return;
     }
-    if(x1 > x2)
+    bool clip = strokeTop < top || strokeBottom > bottom || strokeLeft < 0 || strokeRight > right;
+    uint8_t value = static_cast<uint8_t>(v);
+
+    //Step along the longer axis; x is the major and y the minor coordinate
+    bool steep = std::abs(c2 - c1) > std::abs(r2 - r1);
+    int x1 = steep ? c1 : r1, y1 = steep ? r1 : c1;
+    int x2 = steep ? c2 : r2, y2 = steep ? r2 : c2;
+    if (x1 > x2)
     {
         std::swap(x1, x2);
         std::swap(y1, y2);
     }
-    int y = y1;
-    int dx = x2-x1;
-    int dy = fabs(y2 - y1);
-    //Decision paramaeter I believe
-    float pK = dx /2.0;
-    int yIncr;
-    if (y1 < y2) yIncr = 1;
-    else yIncr = -1;
+    int dx = x2 - x1;
+    int dy = std::abs(y2 - y1);
+    int yIncr = (y1 < y2) ? 1 : -1;
+    //Twice the decision parameter, so it stays an integer
+    int pK = dx;
+    int y = y1, runStart = x1;
     for (int x = x1; x <= x2; x++)
     {
-        if (fabs(y2_Or - y1_Or) > fabs(x2_Or - x1_Or))
+        pK -= 2 * dy;
+        if (pK < 0 || x == x2)
         {
-            edgeNodes.push_back(std::make_pair(y,x));
+            //The run of points at minor coordinate y ends at x
+            if (steep)
+            {
+                fillRect(y - half, y - half + ra, runStart - half, x - half + ra, value, top, bottom, clip);
+            }
+            else
+            {
+                fillRect(runStart - half, x - half + ra, y - half, y - half + ra, value, top, bottom, clip);
+            }
+            runStart = x + 1;
         }
-        else
+        if (pK < 0)
         {
-            edgeNodes.push_back(std::make_pair(x,y));
+            y += yIncr;
+            pK += 2 * dx;
         }
-        pK -= dy;
-        if(pK < 0)
+    }
+}
+
+/** \brief  Fills rows rowLo..rowHi and columns colLo..colHi,
+ *          inclusive, with v using one memset per row. When
+ *          clip is set the rectangle is first cut to rows
+ *          top..bottom and to the canvas columns.
+ *
+ *          @return void
+ */
+inline void Image::fillRect(int rowLo, int rowHi, int colLo, int colHi, uint8_t v, int top, int bottom, bool clip)
+{
+    if (clip)
+    {
+        rowLo = std::max(rowLo, top);
+        rowHi = std::min(rowHi, bottom);
+        colLo = std::max(colLo, 0);
+        colHi = std::min(colHi, static_cast<int>(numColumns) - 1);
+        if (rowLo > rowHi || colLo > colHi)
         {
-            y += yIncr;
-            pK += dx;
+            return;
         }
     }
-    return edgeNodes;  
+    uint8_t *row = pixels + static_cast<size_t>(rowLo) * stride + colLo;
+    size_t width = static_cast<size_t>(colHi - colLo + 1);
+    METRICS_COUNT(PIXELS_WRITTEN, width * static_cast<size_t>(rowHi - rowLo + 1));
+    for (int i = rowLo; i <= rowHi; i++, row += stride)
+    {
+        std::memset(row, v, width);
+    }
 }
 
 /** \brief  A helper funtion that take an OsmNode as a
- * 	        parameter and will return that nodes (x,y)
- * 	        coordinate in the matrix by converting its
+ * 	        parameter and will return that nodes (row,column)
+ * 	        coordinate in the matrix by projecting its
  * 	        latitude and longitude.
  * 	     
  *           @return std::pair<int,int>
  */
-std::pair<int,int> Image::getMatrixCoord(OsmNode &a)
+std::pair<int,int> Image::getMatrixCoord(const OsmNode &a) const
 {
-    int row = convertLon(a.getLon());
-    int col = convertLat(a.getLat());
-    std::pair<int,int> ret(row,col);
-    return ret;
+    int row = static_cast<int>(std::floor(projection.row(a.getLat())));
+    int col = static_cast<int>(std::floor(projection.column(a.getLon())));
+    return std::pair<int,int>(row, col);
 }
 
 /** \brief  shades in the area around a node starting
@@ -303,19 +651,19 @@ std::pair<int,int> Image::getMatrixCoord(OsmNode &a)
  *          so that the node is highlighted             
 */
 void Image::shadeNode(int row, int col, int ra, int v)
+{
+    this->shadeNode(row, col, ra, v, 0, static_cast<int>(numRows));
+}
+
+/** \brief  Same as shadeNode, but only rows in
+ *          [rowBegin, rowEnd) are written, which lets
+ *          separate threads shade separate bands.
+*/
+void Image::shadeNode(int row, int col, int ra, int v, int rowBegin, int rowEnd)
 {
     //row, column, radius, greyscale.
     int startRow = row - (ra/2);
     int startCol = col - (ra/2);
-    for (int i = startRow; i <= startRow + ra; i++)
-    {
-        for (int k = startCol; k <= startCol + ra; k++)
-        {
-            //std::cout <<i<<"  " <<k <<std::endl;
-            if (k > 0 && k < 3000 && i > 0 && i < 3000)
-            {
-            this->m[i][k] = v;
-            }   
-        }
-    }
-}
\ No newline at end of file
+    this->fillRect(startRow, startRow + ra, startCol, startCol + ra, static_cast<uint8_t>(v),
+                   std::max(rowBegin, 0), std::min(rowEnd, static_cast<int>(numRows)) - 1, true);
+}
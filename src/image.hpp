@@ -4,29 +4,79 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 #include <string>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
 #include "osm.hpp"
+#include "projection.hpp"
+class ThreadPool;
 class Image {
     public:
-        // constructors and destructor
+        // PGM encodings: ASCII P2 or binary P5
+        enum Format { PGM_ASCII, PGM_BINARY };
+        // constructors and destructor. Strokes are drawn on workers when
+        // given, which must not be the pool the caller is running on, else
+        // on a pool the image starts on first use and keeps.
         Image();
-        Image(Osm &osm, unsigned r = 5000, unsigned c = 5000);
+        Image(Osm &osm, unsigned r = 5000, unsigned c = 5000,
+              Projection::Type projection = Projection::EQUIRECTANGULAR, ThreadPool *workers = nullptr);
+        // Same as above for one version of a map, as returned by Osm::snapshot()
+        Image(const MapState &map, unsigned r = 5000, unsigned c = 5000,
+              Projection::Type projection = Projection::EQUIRECTANGULAR, ThreadPool *workers = nullptr);
+        // Blank white canvas of r rows and c columns
+        Image(unsigned r, unsigned c, ThreadPool *workers = nullptr);
         ~Image();
+        Image(const Image &) = delete;
+        Image& operator=(const Image &) = delete;
         // Image drawing utilities
         void drawRoute(const std::vector<OsmNode> &);
-        void saveImage(const std::string& pgmPath) const;
+        // Shades the edges and nodes of an isochrone, darker where they are cheaper
+        // to reach. False, drawing nothing, unless it was searched on this map version.
+        bool drawIsochrone(const MapState &map, const Isochrone &reached);
+        bool drawIsochrone(Osm &osm, const Isochrone &reached);
+        void saveImage(const std::string& pgmPath, Format format = PGM_BINARY) const;
+        // Writes the image as PGM at the current position of an open file
+        bool writeImage(int fd, Format format = PGM_BINARY) const;
+        // Paints the whole canvas white again
+        void clear();
+        // True if every pixel is still white
+        bool isBlank() const;
+        // Draws a line between two pixels with a square brush of size ra
+        void drawSegment(int r1, int c1, int r2, int c2, int ra, int v);
         
     private:
-        int **m;
+        // A line between two pixels, drawn in one grey value
+        struct Stroke {
+            int r1, c1, r2, c2;
+            uint8_t value;
+        };
+        // numRows rows of greyscale pixels, row i starts at pixels + i * stride
+        uint8_t *pixels;
+        size_t stride;
         unsigned numRows, numColumns;
-        // canvas size (bounding lat/lon)
-        double minLat, maxLat, minLon, maxLon;
-        double convertLon(double a) const;
-        double convertLat(double b) const;
-        void drawNodes(Osm &o);
-        void drawEdges(Osm &o);
+        // Maps the map bounds onto the canvas, once fitted to some map
+        Projection projection;
+        bool fitted;
+        // Pixel position of every graph node of map version projectedVersion,
+        // or of none while it is 0
+        std::vector<int32_t> nodeRows, nodeColumns;
+        uint64_t projectedVersion;
+        // Workers passed in, or else ownPool once strokes have been drawn
+        ThreadPool *pool;
+        std::unique_ptr<ThreadPool> ownPool;
+        void allocate(unsigned r, unsigned c);
+        bool writeBinary(int fd) const;
+        bool writeAscii(int fd) const;
+        void projectNodes(const MapState &map);
+        void drawNodes(const Graph &g);
+        void drawEdges(const Graph &g);
+        ThreadPool &strokePool();
+        void drawStrokes(const std::vector<Stroke> &strokes, int ra);
         void shadeNode(int ro, int c, int ra, int v);
-        std::vector<std::pair<int,int>> getEdgeCoords(std::pair<int,int> src ,std::pair<int,int> dest);
-        std::pair<int,int> getMatrixCoord(OsmNode &a);
+        void shadeNode(int ro, int c, int ra, int v, int rowBegin, int rowEnd);
+        void drawLine(int r1, int c1, int r2, int c2, int ra, int v, int rowBegin, int rowEnd);
+        void fillRect(int rowLo, int rowHi, int colLo, int colHi, uint8_t v, int top, int bottom, bool clip);
+        std::pair<int,int> getMatrixCoord(const OsmNode &a) const;
 
 };
 #endif
@@ -0,0 +1,429 @@
+/**
+ * @brief Inflater Class implementation
+ */
+
+#include "inflater.hpp"
+#include <cstring>
+
+namespace {
+    const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                       3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                         257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                         8193, 12289, 16385, 24577 };
+    const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                         7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    // Order in which code length code lengths are stored
+    const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    /** \brief  Adler-32 checksum of a buffer, as used by zlib.
+     *
+     *          @return uint32_t
+    */
+    uint32_t adler32(const uint8_t *data, size_t size)
+    {
+        //5552 is the most bytes that can be summed before the sums can overflow
+        const uint32_t MOD = 65521;
+        uint32_t a = 1, b = 0;
+        while (size > 0)
+        {
+            size_t block = size < 5552 ? size : 5552;
+            size -= block;
+            for (size_t i = 0; i < block; i++)
+            {
+                a += data[i];
+                b += a;
+            }
+            data += block;
+            a %= MOD;
+            b %= MOD;
+        }
+        return (b << 16) | a;
+    }
+}
+
+/** \brief  Private constructor, Inflater is only used
+ *          through inflate().
+*/
+Inflater::Inflater(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize)
+        :in(src), inEnd(src + srcSize), bitBuffer(0), bitCount(0), out(dst), outPos(0),
+         outSize(dstSize), failed(false)
+{
+}
+
+/** \brief  Inflates the zlib stream src into dst, which must
+ *          be exactly the size of the uncompressed data. Fails
+ *          on malformed or truncated input, on output of any
+ *          other size, and on an Adler-32 mismatch.
+ *
+ *          @return bool true if dst holds the inflated data
+*/
+bool Inflater::inflate(const char *src, size_t srcSize, char *dst, size_t dstSize)
+{
+    Inflater inflater(reinterpret_cast<const uint8_t *>(src), srcSize, reinterpret_cast<uint8_t *>(dst), dstSize);
+    return inflater.run();
+}
+
+/** \brief  Tops the bit buffer up to at least 57 bits, or as
+ *          many as the input has left.
+ *
+ *          @return void
+*/
+inline void Inflater::refill()
+{
+    while (bitCount <= 56 && in < inEnd)
+    {
+        bitBuffer |= static_cast<uint64_t>(*in++) << bitCount;
+        bitCount += 8;
+    }
+}
+
+/** \brief  Takes count bits, least significant first, marking
+ *          the stream as failed if the input runs out.
+ *
+ *          @return unsigned
+*/
+inline unsigned Inflater::bits(unsigned count)
+{
+    if (bitCount < count)
+    {
+        refill();
+        if (bitCount < count)
+        {
+            failed = true;
+            return 0;
+        }
+    }
+    unsigned value = static_cast<unsigned>(bitBuffer & ((uint64_t(1) << count) - 1));
+    bitBuffer >>= count;
+    bitCount -= count;
+    return value;
+}
+
+/** \brief  Decodes one symbol. Short codes come straight from
+ *          the lookup table, longer ones are read a bit at a
+ *          time against the canonical code counts.
+ *
+ *          @return int the symbol, or -1 on bad input
+*/
+inline int Inflater::decode(const Huffman &h)
+{
+    if (bitCount < 15)
+    {
+        refill();
+    }
+    uint16_t entry = h.fast[bitBuffer & ((1u << FAST_BITS) - 1)];
+    if (entry != 0 && (entry & 15u) <= bitCount)
+    {
+        bitBuffer >>= (entry & 15u);
+        bitCount -= (entry & 15u);
+        return entry >> 4;
+    }
+    int code = 0, first = 0, index = 0;
+    for (unsigned length = 1; length < 16; length++)
+    {
+        if (bitCount == 0)
+        {
+            return -1;
+        }
+        code |= static_cast<int>(bitBuffer & 1);
+        bitBuffer >>= 1;
+        bitCount--;
+        int count = h.counts[length];
+        if (code - count < first)
+        {
+            return h.symbols[index + (code - first)];
+        }
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+/** \brief  Builds the code for n symbols from their code
+ *          lengths, where 0 means the symbol is unused. An
+ *          over-subscribed set of lengths is rejected.
+ *
+ *          @return bool
+*/
+bool Inflater::buildHuffman(Huffman &h, const uint8_t *lengths, unsigned n)
+{
+    std::memset(h.counts, 0, sizeof(h.counts));
+    std::memset(h.fast, 0, sizeof(h.fast));
+    for (unsigned s = 0; s < n; s++)
+    {
+        h.counts[lengths[s]]++;
+    }
+    h.counts[0] = 0;
+    int left = 1;
+    for (unsigned length = 1; length < 16; length++)
+    {
+        left = (left << 1) - h.counts[length];
+        if (left < 0)
+        {
+            return false;
+        }
+    }
+    uint16_t offsets[16];
+    uint16_t nextCode[16];
+    offsets[1] = 0;
+    nextCode[1] = 0;
+    for (unsigned length = 1; length < 15; length++)
+    {
+        offsets[length + 1] = offsets[length] + h.counts[length];
+        nextCode[length + 1] = static_cast<uint16_t>((nextCode[length] + h.counts[length]) << 1);
+    }
+    for (unsigned s = 0; s < n; s++)
+    {
+        unsigned length = lengths[s];
+        if (length == 0)
+        {
+            continue;
+        }
+        h.symbols[offsets[length]++] = static_cast<uint16_t>(s);
+        unsigned code = nextCode[length]++;
+        if (length <= FAST_BITS)
+        {
+            //Codes are stored most significant bit first, so the table index is the code reversed
+            unsigned reversed = 0;
+            for (unsigned i = 0; i < length; i++)
+            {
+                reversed |= ((code >> i) & 1u) << (length - 1 - i);
+            }
+            for (unsigned j = reversed; j < (1u << FAST_BITS); j += (1u << length))
+            {
+                h.fast[j] = static_cast<uint16_t>((s << 4) | length);
+            }
+        }
+    }
+    return true;
+}
+
+/** \brief  Copies a stored block, which starts at the next
+ *          byte boundary.
+ *
+ *          @return bool
+*/
+bool Inflater::stored()
+{
+    bitBuffer >>= (bitCount & 7u);
+    bitCount -= (bitCount & 7u);
+    unsigned length = bits(16);
+    unsigned complement = bits(16);
+    if (failed || length != (~complement & 0xffffu) || outSize - outPos < length)
+    {
+        return false;
+    }
+    //Whole bytes may still be waiting in the bit buffer
+    while (length > 0 && bitCount > 0)
+    {
+        out[outPos++] = static_cast<uint8_t>(bits(8));
+        length--;
+    }
+    if (static_cast<size_t>(inEnd - in) < length)
+    {
+        return false;
+    }
+    std::memcpy(out + outPos, in, length);
+    in += length;
+    outPos += length;
+    return true;
+}
+
+/** \brief  Decodes literals and length/distance pairs until
+ *          the end of block symbol.
+ *
+ *          @return bool
+*/
+bool Inflater::codes(const Huffman &lengthCodes, const Huffman &distanceCodes)
+{
+    while (true)
+    {
+        int symbol = decode(lengthCodes);
+        if (symbol < 0)
+        {
+            return false;
+        }
+        if (symbol < 256)
+        {
+            if (outPos == outSize)
+            {
+                return false;
+            }
+            out[outPos++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        if (symbol == 256)
+        {
+            return true;
+        }
+        symbol -= 257;
+        if (symbol >= 29)
+        {
+            return false;
+        }
+        size_t length = LENGTH_BASE[symbol] + bits(LENGTH_EXTRA[symbol]);
+        int distanceSymbol = decode(distanceCodes);
+        if (distanceSymbol < 0 || distanceSymbol >= 30)
+        {
+            return false;
+        }
+        size_t distance = DISTANCE_BASE[distanceSymbol] + bits(DISTANCE_EXTRA[distanceSymbol]);
+        if (failed || distance > outPos || outSize - outPos < length)
+        {
+            return false;
+        }
+        //The source may overlap the bytes being written, so copy forwards one at a time
+        const uint8_t *from = out + outPos - distance;
+        uint8_t *to = out + outPos;
+        for (size_t i = 0; i < length; i++)
+        {
+            to[i] = from[i];
+        }
+        outPos += length;
+    }
+}
+
+/** \brief  Decodes a block compressed with the fixed codes.
+ *
+ *          @return bool
+*/
+bool Inflater::fixed()
+{
+    Huffman lengthCodes, distanceCodes;
+    uint8_t lengths[288];
+    std::memset(lengths, 8, 144);
+    std::memset(lengths + 144, 9, 112);
+    std::memset(lengths + 256, 7, 24);
+    std::memset(lengths + 280, 8, 8);
+    buildHuffman(lengthCodes, lengths, 288);
+    std::memset(lengths, 5, 30);
+    buildHuffman(distanceCodes, lengths, 30);
+    return codes(lengthCodes, distanceCodes);
+}
+
+/** \brief  Reads the code lengths of a dynamic block, which
+ *          are themselves Huffman coded, then decodes it.
+ *
+ *          @return bool
+*/
+bool Inflater::dynamic()
+{
+    unsigned literalCount = bits(5) + 257;
+    unsigned distanceCount = bits(5) + 1;
+    unsigned codeLengthCount = bits(4) + 4;
+    if (failed || literalCount > 286 || distanceCount > 30)
+    {
+        return false;
+    }
+    uint8_t lengths[286 + 30];
+    std::memset(lengths, 0, 19);
+    for (unsigned i = 0; i < codeLengthCount; i++)
+    {
+        lengths[CODE_LENGTH_ORDER[i]] = static_cast<uint8_t>(bits(3));
+    }
+    Huffman lengthCodes, distanceCodes;
+    if (failed || !buildHuffman(lengthCodes, lengths, 19))
+    {
+        return false;
+    }
+    unsigned index = 0;
+    while (index < literalCount + distanceCount)
+    {
+        int symbol = decode(lengthCodes);
+        if (symbol < 0)
+        {
+            return false;
+        }
+        if (symbol < 16)
+        {
+            lengths[index++] = static_cast<uint8_t>(symbol);
+            continue;
+        }
+        uint8_t value = 0;
+        unsigned repeat;
+        if (symbol == 16)
+        {
+            if (index == 0)
+            {
+                return false;
+            }
+            value = lengths[index - 1];
+            repeat = 3 + bits(2);
+        }
+        else if (symbol == 17)
+        {
+            repeat = 3 + bits(3);
+        }
+        else
+        {
+            repeat = 11 + bits(7);
+        }
+        if (failed || index + repeat > literalCount + distanceCount)
+        {
+            return false;
+        }
+        std::memset(lengths + index, value, repeat);
+        index += repeat;
+    }
+    //A block without an end of block code could never finish
+    if (lengths[256] == 0)
+    {
+        return false;
+    }
+    if (!buildHuffman(lengthCodes, lengths, literalCount) ||
+        !buildHuffman(distanceCodes, lengths + literalCount, distanceCount))
+    {
+        return false;
+    }
+    return codes(lengthCodes, distanceCodes);
+}
+
+/** \brief  Checks the zlib header, inflates every block and
+ *          checks the Adler-32 trailer.
+ *
+ *          @return bool
+*/
+bool Inflater::run()
+{
+    unsigned cmf = bits(8);
+    unsigned flg = bits(8);
+    //Method 8 is DEFLATE, and a preset dictionary is never used by PBF writers
+    if (failed || (cmf & 15u) != 8 || (cmf >> 4) > 7 || (cmf * 256 + flg) % 31 != 0 || (flg & 0x20u))
+    {
+        return false;
+    }
+    unsigned last;
+    do
+    {
+        last = bits(1);
+        unsigned type = bits(2);
+        bool ok;
+        if (failed)
+        {
+            return false;
+        }
+        switch (type)
+        {
+            case 0: ok = stored(); break;
+            case 1: ok = fixed(); break;
+            case 2: ok = dynamic(); break;
+            default: ok = false; break;
+        }
+        if (!ok || failed)
+        {
+            return false;
+        }
+    } while (!last);
+    bitBuffer >>= (bitCount & 7u);
+    bitCount -= (bitCount & 7u);
+    uint32_t expected = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        expected = (expected << 8) | bits(8);
+    }
+    return !failed && outPos == outSize && expected == adler32(out, outSize);
+}
@@ -0,0 +1,44 @@
+/**
+ * @brief Inflater Class header
+ */
+#ifndef INFLATER_H
+#define INFLATER_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Decoder for zlib streams (RFC 1950) holding DEFLATE data (RFC 1951)
+class Inflater {
+    private:
+        // Codes of up to FAST_BITS bits are decoded with one table lookup
+        static const unsigned FAST_BITS = 10;
+        // Canonical Huffman code for one alphabet
+        struct Huffman {
+            uint16_t fast[1u << FAST_BITS];     /** symbol << 4 | length, 0 if the code is longer */
+            uint16_t counts[16];                /** number of codes of each length */
+            uint16_t symbols[288];              /** symbols ordered by code */
+        };
+        const uint8_t *in, *inEnd;
+        uint64_t bitBuffer;
+        unsigned bitCount;
+        uint8_t *out;
+        size_t outPos, outSize;
+        bool failed;
+
+        Inflater(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+        void refill();
+        unsigned bits(unsigned count);
+        int decode(const Huffman &h);
+        bool buildHuffman(Huffman &h, const uint8_t *lengths, unsigned n);
+        bool stored();
+        bool codes(const Huffman &lengthCodes, const Huffman &distanceCodes);
+        bool fixed();
+        bool dynamic();
+        bool run();
+
+    public:
+        // Inflates a zlib stream into exactly dstSize bytes, checking its Adler-32
+        static bool inflate(const char *src, size_t srcSize, char *dst, size_t dstSize);
+};
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @brief MappedFile Class implementation
+ */
+
+#include "mappedfile.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** \brief  Constructor that opens the given file and maps
+ *          it read-only into memory. If the file cannot be
+ *          opened or mapped the object is left closed and
+ *          isOpen() returns false. Files mapped as sequential
+ *          are read ahead aggressively, others are left to the
+ *          default paging for random access.
+*/
+MappedFile::MappedFile(const std::string &path, bool sequential)
+        :data(nullptr), length(0), opened(false)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0)
+    {
+        length = static_cast<size_t>(info.st_size);
+        if (length == 0)
+        {
+            opened = true;
+        }
+        else
+        {
+            void *addr = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED)
+            {
+                if (sequential)
+                {
+                    ::madvise(addr, length, MADV_SEQUENTIAL);
+                }
+                data = static_cast<const char *>(addr);
+                opened = true;
+            }
+            else
+            {
+                length = 0;
+            }
+        }
+    }
+    ::close(fd);
+}
+
+/** \brief  Destructor that unmaps the file.
+*/
+MappedFile::~MappedFile()
+{
+    if (data != nullptr)
+    {
+        ::munmap(const_cast<char *>(data), length);
+    }
+}
+
+/** \brief  Returns true if the file was opened and mapped.
+ *
+ *          @return bool
+*/
+bool MappedFile::isOpen() const
+{
+    return opened;
+}
+
+/** \brief  Returns a pointer to the first byte of the file.
+ *
+ *          @return const char *
+*/
+const char *MappedFile::begin() const
+{
+    return data;
+}
+
+/** \brief  Returns a pointer one past the last byte of the file.
+ *
+ *          @return const char *
+*/
+const char *MappedFile::end() const
+{
+    return data + length;
+}
+
+/** \brief  Returns the size of the mapped file in bytes.
+ *
+ *          @return size_t
+*/
+size_t MappedFile::size() const
+{
+    return length;
+}
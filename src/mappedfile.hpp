@@ -0,0 +1,28 @@
+/**
+ * @brief MappedFile Class header
+ */
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+class MappedFile {
+    private:
+        const char *data;
+        size_t length;
+        bool opened;
+
+    public:
+        // sequential tells the kernel the file will be read once from start to end
+        MappedFile(const std::string &, bool sequential = true);
+        ~MappedFile();
+        MappedFile(const MappedFile &) = delete;
+        MappedFile& operator=(const MappedFile &) = delete;
+        bool isOpen() const;
+        const char *begin() const;
+        const char *end() const;
+        size_t size() const;
+};
+
+#endif
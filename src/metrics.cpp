@@ -0,0 +1,336 @@
+/**
+ * @brief Metrics Class implementation
+ */
+
+#include "metrics.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+    // Counts of one thread. Only the owning thread writes them, other
+    // threads only read, so relaxed loads and stores are enough.
+    struct Block {
+        std::atomic<uint64_t> counters[Metrics::COUNTERS];
+        std::atomic<uint64_t> calls[Metrics::PHASES];
+        std::atomic<uint64_t> nanos[Metrics::PHASES];
+        Block()
+        {
+            clear();
+        }
+        void clear()
+        {
+            for (std::atomic<uint64_t> &c : counters) c.store(0, std::memory_order_relaxed);
+            for (std::atomic<uint64_t> &c : calls) c.store(0, std::memory_order_relaxed);
+            for (std::atomic<uint64_t> &c : nanos) c.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    // Every live thread's block, and the sums of exited threads
+    struct Registry {
+        std::mutex lock;
+        std::vector<Block *> live;
+        Metrics::Totals retired;
+    };
+
+    /** \brief  Returns the registry. It is never destroyed, so
+     *          threads that exit during static destruction can
+     *          still hand in their counts.
+     *
+     *          @return Registry &
+    */
+    Registry &registry()
+    {
+        static Registry *r = new Registry();
+        return *r;
+    }
+
+    void addBlock(const Block &block, Metrics::Totals &sum)
+    {
+        for (int i = 0; i < Metrics::COUNTERS; i++)
+        {
+            sum.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+        }
+        for (int i = 0; i < Metrics::PHASES; i++)
+        {
+            sum.calls[i] += block.calls[i].load(std::memory_order_relaxed);
+            sum.nanos[i] += block.nanos[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // The calling thread's block once its slot is registered, and whether
+    // the slot is being set up or is gone. Plain thread_locals with no
+    // constructor, so operator new can read them at any time.
+    thread_local Block *current = nullptr;
+    thread_local bool registering = false;
+    thread_local bool exited = false;
+
+    // Registers a block for its thread on first use and folds it into
+    // the retired sums when the thread exits
+    struct ThreadSlot {
+        Block *block;
+        ThreadSlot() : block(nullptr)
+        {
+            registering = true;
+            block = new Block();
+            Registry &r = registry();
+            {
+                std::lock_guard<std::mutex> hold(r.lock);
+                r.live.push_back(block);
+            }
+            current = block;
+            registering = false;
+        }
+        ~ThreadSlot()
+        {
+            current = nullptr;
+            exited = true;
+            Registry &r = registry();
+            std::lock_guard<std::mutex> hold(r.lock);
+            addBlock(*block, r.retired);
+            r.live.erase(std::find(r.live.begin(), r.live.end(), block));
+            delete block;
+        }
+    };
+
+    thread_local ThreadSlot slot;
+
+    void bump(std::atomic<uint64_t> &value, uint64_t n)
+    {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+#if OSM_METRICS
+    /** \brief  Counts one allocation of bytes on the calling
+     *          thread. The allocations made while its slot is
+     *          set up or torn down are not counted, since there
+     *          is no block to count them in.
+     *
+     *          @return void
+    */
+    void countAllocation(size_t bytes)
+    {
+        if (current == nullptr)
+        {
+            if (registering || exited)
+            {
+                return;
+            }
+            (void)slot.block;
+        }
+        bump(current->counters[Metrics::ALLOCATIONS], 1);
+        bump(current->counters[Metrics::BYTES_ALLOCATED], bytes);
+    }
+
+    /** \brief  Allocates like the default operator new, calling
+     *          the new handler until it frees enough memory or
+     *          there is none, and counts the allocation.
+     *
+     *          @return void * never null
+    */
+    void *allocate(size_t bytes)
+    {
+        void *p;
+        while ((p = std::malloc(bytes == 0 ? 1 : bytes)) == nullptr)
+        {
+            std::new_handler handler = std::get_new_handler();
+            if (handler == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+            handler();
+        }
+        countAllocation(bytes);
+        return p;
+    }
+#endif
+}
+
+#if OSM_METRICS
+// The allocation counters, for every new in the program
+void *operator new(size_t bytes)
+{
+    return allocate(bytes);
+}
+
+void *operator new[](size_t bytes)
+{
+    return allocate(bytes);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+#endif
+
+/** \brief  Adds n to a counter of the calling thread.
+ *
+ *          @return void
+*/
+void Metrics::count(Counter counter, uint64_t n)
+{
+    bump(slot.block->counters[counter], n);
+}
+
+/** \brief  Adds one call taking nanos nanoseconds to a phase
+ *          of the calling thread.
+ *
+ *          @return void
+*/
+void Metrics::record(Phase phase, uint64_t nanos)
+{
+    Block &block = *slot.block;
+    bump(block.calls[phase], 1);
+    bump(block.nanos[phase], nanos);
+}
+
+/** \brief  Sums the counts of every thread, live or exited.
+ *
+ *          @return Metrics::Totals
+*/
+Metrics::Totals Metrics::totals()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> hold(r.lock);
+    Totals sum = r.retired;
+    for (const Block *block : r.live)
+    {
+        addBlock(*block, sum);
+    }
+    return sum;
+}
+
+/** \brief  Zeroes the counts of every thread.
+ *
+ *          @return void
+*/
+void Metrics::reset()
+{
+    Registry &r = registry();
+    std::lock_guard<std::mutex> hold(r.lock);
+    r.retired = Totals();
+    for (Block *block : r.live)
+    {
+        block->clear();
+    }
+}
+
+/** \brief  Returns the name of a counter, as exported.
+ *
+ *          @return const char *
+*/
+const char *Metrics::name(Counter counter)
+{
+    switch (counter)
+    {
+        case NODES_PARSED: return "nodes_parsed";
+        case WAYS_PARSED: return "ways_parsed";
+        case EDGES_ADDED: return "edges_added";
+        case ROUTE_QUERIES: return "route_queries";
+        case NODES_SETTLED: return "nodes_settled";
+        case QUEUE_PUSHES: return "queue_pushes";
+        case PIXELS_WRITTEN: return "pixels_written";
+        case ROUTE_CACHE_HITS: return "route_cache_hits";
+        case ROUTE_CACHE_MISSES: return "route_cache_misses";
+        case ALLOCATIONS: return "allocations";
+        case BYTES_ALLOCATED: return "bytes_allocated";
+        case COUNTERS: break;
+    }
+    return "";
+}
+
+/** \brief  Returns the name of a phase, as exported.
+ *
+ *          @return const char *
+*/
+const char *Metrics::name(Phase phase)
+{
+    switch (phase)
+    {
+        case OSM_PARSE: return "osm_parse";
+        case OSM_BUILD_GRAPH: return "osm_build_graph";
+        case COMPUTE_ROUTE: return "compute_route";
+        case DRAW_EDGES: return "draw_edges";
+        case SAVE_IMAGE: return "save_image";
+        case PHASES: break;
+    }
+    return "";
+}
+
+/** \brief  Returns the totals as a single line of JSON: every
+ *          counter, the calls and milliseconds of every phase,
+ *          and the nodes settled and queue pushes per route
+ *          query.
+ *
+ *          @return std::string
+*/
+std::string Metrics::json()
+{
+    Totals t = totals();
+    std::string out = "{\"counters\":{";
+    char text[128];
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        std::snprintf(text, sizeof(text), "%s\"%s\":%llu", i ? "," : "", name(static_cast<Counter>(i)),
+                      static_cast<unsigned long long>(t.counters[i]));
+        out += text;
+    }
+    out += "},\"phases\":{";
+    for (int i = 0; i < PHASES; i++)
+    {
+        std::snprintf(text, sizeof(text), "%s\"%s\":{\"calls\":%llu,\"total_ms\":%.3f}", i ? "," : "",
+                      name(static_cast<Phase>(i)), static_cast<unsigned long long>(t.calls[i]), t.nanos[i] / 1e6);
+        out += text;
+    }
+    double queries = static_cast<double>(std::max<uint64_t>(t.counters[ROUTE_QUERIES], 1));
+    std::snprintf(text, sizeof(text), "},\"per_query\":{\"nodes_settled\":%.1f,\"queue_pushes\":%.1f}}",
+                  t.counters[NODES_SETTLED] / queries, t.counters[QUEUE_PUSHES] / queries);
+    out += text;
+    return out;
+}
+
+/** \brief  Returns the totals in the Prometheus text format,
+ *          each counter as osm_<name>_total and the phases as
+ *          osm_phase_calls_total and osm_phase_seconds_total
+ *          labelled by phase.
+ *
+ *          @return std::string
+*/
+std::string Metrics::prometheus()
+{
+    Totals t = totals();
+    std::string out;
+    char text[160];
+    for (int i = 0; i < COUNTERS; i++)
+    {
+        const char *counter = name(static_cast<Counter>(i));
+        std::snprintf(text, sizeof(text), "# TYPE osm_%s_total counter\nosm_%s_total %llu\n", counter, counter,
+                      static_cast<unsigned long long>(t.counters[i]));
+        out += text;
+    }
+    out += "# TYPE osm_phase_calls_total counter\n";
+    for (int i = 0; i < PHASES; i++)
+    {
+        std::snprintf(text, sizeof(text), "osm_phase_calls_total{phase=\"%s\"} %llu\n", name(static_cast<Phase>(i)),
+                      static_cast<unsigned long long>(t.calls[i]));
+        out += text;
+    }
+    out += "# TYPE osm_phase_seconds_total counter\n";
+    for (int i = 0; i < PHASES; i++)
+    {
+        std::snprintf(text, sizeof(text), "osm_phase_seconds_total{phase=\"%s\"} %.9f\n", name(static_cast<Phase>(i)),
+                      t.nanos[i] / 1e9);
+        out += text;
+    }
+    return out;
+}
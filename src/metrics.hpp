@@ -0,0 +1,72 @@
+/**
+ * @brief Metrics Class header
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Build with -DOSM_METRICS=0 to compile every METRICS_ macro to nothing
+#ifndef OSM_METRICS
+#define OSM_METRICS 1
+#endif
+
+// Counters and phase timers for the hot paths. Each thread adds to its
+// own block, so recording is a plain load and store with no locking or
+// shared cache lines. Blocks are summed when totals are read, and the
+// counts of exited threads are kept. With OSM_METRICS on, the global
+// operator new is replaced to count every allocation and its bytes.
+class Metrics {
+    public:
+        enum Counter { NODES_PARSED, WAYS_PARSED, EDGES_ADDED, ROUTE_QUERIES, NODES_SETTLED, QUEUE_PUSHES,
+                       PIXELS_WRITTEN, ROUTE_CACHE_HITS, ROUTE_CACHE_MISSES, ALLOCATIONS, BYTES_ALLOCATED,
+                       COUNTERS };
+        enum Phase { OSM_PARSE, OSM_BUILD_GRAPH, COMPUTE_ROUTE, DRAW_EDGES, SAVE_IMAGE, PHASES };
+        // Sums over every thread
+        struct Totals {
+            uint64_t counters[COUNTERS];
+            uint64_t calls[PHASES];
+            uint64_t nanos[PHASES];
+        };
+
+        static void count(Counter counter, uint64_t n);
+        static void record(Phase phase, uint64_t nanos);
+        static Totals totals();
+        // Zeroes every counter; counts recorded at the same time may survive
+        static void reset();
+        static const char *name(Counter counter);
+        static const char *name(Phase phase);
+        // Totals as one line of JSON, with settled nodes and pushes per route query
+        static std::string json();
+        // Totals in the Prometheus text exposition format
+        static std::string prometheus();
+};
+
+// Records the time from its construction to the end of its scope
+class PhaseTimer {
+    private:
+        Metrics::Phase phase;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+        explicit PhaseTimer(Metrics::Phase timed) : phase(timed), start(std::chrono::steady_clock::now()) {}
+        ~PhaseTimer()
+        {
+            Metrics::record(phase, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count()));
+        }
+        PhaseTimer(const PhaseTimer &) = delete;
+        PhaseTimer& operator=(const PhaseTimer &) = delete;
+};
+
+#if OSM_METRICS
+#define METRICS_COUNT(counter, n) Metrics::count(Metrics::counter, (n))
+#define METRICS_PHASE(phase) PhaseTimer metricsPhaseTimer(Metrics::phase)
+#else
+#define METRICS_COUNT(counter, n) ((void)0)
+#define METRICS_PHASE(phase) ((void)0)
+#endif
+
+#endif
@@ -3,209 +3,952 @@
  */
 
 #include "osm.hpp"
-#include <fstream>
-#include <regex>
+#include "mappedfile.hpp"
+#include "osmscanner.hpp"
+#include "threadpool.hpp"
+#include "idcollector.hpp"
+#include "pbfreader.hpp"
+#include "osmchange.hpp"
+#include "metrics.hpp"
+#include <memory>
+#include <algorithm>
 #include <iostream>
-#include <queue>
+#include <cstdlib>
+#include <numeric>
+#include <thread>
+
+namespace {
+    /** \brief  Drops the nodes of a chunk whose ids the
+     *          collector does not have, keeping the others in
+     *          file order. The ids are looked up in increasing
+     *          order, which is file order in most files, so the
+     *          collector's merge only goes forward; order and
+     *          used are scratch space kept between chunks.
+     *
+     *          @return void
+    */
+    void keepCollected(ChunkScan &chunk, IdCollector &collected, std::vector<uint32_t> &order,
+                       std::vector<char> &used)
+    {
+        size_t n = chunk.ids.size();
+        order.resize(n);
+        std::iota(order.begin(), order.end(), 0);
+        if (!std::is_sorted(chunk.ids.begin(), chunk.ids.end()))
+        {
+            std::stable_sort(order.begin(), order.end(),
+                [&chunk](uint32_t a, uint32_t b) { return chunk.ids[a] < chunk.ids[b]; });
+        }
+        used.resize(n);
+        for (uint32_t i : order)
+        {
+            used[i] = collected.contains(chunk.ids[i]);
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (used[i])
+            {
+                chunk.ids[kept] = chunk.ids[i];
+                chunk.lats[kept] = chunk.lats[i];
+                chunk.lons[kept] = chunk.lons[i];
+                kept++;
+            }
+        }
+        chunk.ids.resize(kept);
+        chunk.lats.resize(kept);
+        chunk.lons.resize(kept);
+    }
+}
 
 /** \brief  Constructor that takes in name of Osmfile
  *          and will parse all nodes and ways within
- *          Osm file and create adjacency list.             
+ *          Osm file and create adjacency list. .osm.pbf
+ *          files are recognised by their first blob and read
+ *          the same way. With
+ *          options.routableOnly set only the nodes on highway
+ *          ways are kept, which bounds memory on large
+ *          extracts. Arcs are weighted by options.profile. If
+ *          the file is a snapshot written by
+ *          save() it is mapped and used in place instead, and
+ *          InvalidSnapshot is thrown if it is from another
+ *          format version or fails its checksums. A snapshot
+ *          has no ways, so it cannot be updated by applyChange.
 */
-Osm::Osm(const std::string &osmFileName):pathName(osmFileName)
+Osm::Osm(const std::string &osmFileName, const OsmLoadOptions &options)
+        :pathName(osmFileName), state(std::make_shared<MapState>()), routeCache(options.routeCacheSize),
+         updatable(options.updatable)
 {
+    state->version = RouteCache::nextVersion();
+    state->graph.setProfile(Profile(options.profile));
+    if (Graph::isSnapshot(pathName))
+    {
+        if (!state->graph.mapSnapshot(pathName, state->bounds))
+        {
+            throw InvalidSnapshot();
+        }
+        updatable = false;
+        return;
+    }
     // read in the OSM file and parse nodes and highways
-    this->parseNodes();
-    this->initializeAdjList();
+    if (options.routableOnly)
+    {
+        this->parseRoutable(options.memoryBudget, options.threads);
+    }
+    else
+    {
+        this->parseOsm(options.threads);
+    }
 }
 
 /** \brief  Public function that returns a vector<OsmNodes> that
- *          represent the route between two provided nodes in the parameters.
- *          Uses Breadth First Search to search map while keeping track
- *          of parent nodes to backtrack.
+ *          represent the route between two provided nodes in the parameters,
+ *          ordered from source to destination. By default the route is the
+ *          shortest one by distance, found with A*; Router::BFS gives the
+ *          route with the fewest edges instead. Router::CONTRACTION_HIERARCHY
+ *          answers from the contraction hierarchy, building it if needed.
  *  
  *          @return std::vector<OsmNode>              
 */
-std::vector<OsmNode> Osm::computeRoute(const std::string &srcId, const std::string &destId)  
+std::vector<OsmNode> Osm::computeRoute(const std::string &srcId, const std::string &destId, Router::Mode mode)  
 {    
+    std::shared_ptr<const MapState> map = indexedSnapshot(false, mode == Router::CONTRACTION_HIERARCHY);
+    return routeNodes(map->graph, this->findRoute(*map, srcId, destId, mode));
+}
+
+/** \brief  Public function that finds the route between two
+ *          provided node ids and returns it as graph indices
+ *          together with its length in metres. The route is
+ *          empty if either id is unknown or dest cannot be
+ *          reached.
+ *  
+ *          @return Route
+*/
+Route Osm::findRoute(const std::string &srcId, const std::string &destId, Router::Mode mode)
+{
+    return this->findRoute(*indexedSnapshot(false, mode == Router::CONTRACTION_HIERARCHY), srcId, destId, mode);
+}
+
+/** \brief  Finds the route between two node ids on one map
+ *          version, which must have a hierarchy if mode
+ *          needs it.
+ *
+ *          @return Route
+*/
+Route Osm::findRoute(const MapState &map, const std::string &srcId, const std::string &destId,
+                     Router::Mode mode)
+{
+    METRICS_PHASE(COMPUTE_ROUTE);
+    uint32_t src = map.graph.indexOf(std::strtoull(srcId.c_str(), nullptr, 10));
+    uint32_t dest = map.graph.indexOf(std::strtoull(destId.c_str(), nullptr, 10));
+    return this->cachedRoute(map, router, src, dest, mode);
+}
+
+/** \brief  Public function that returns the route between two
+ *          coordinates as OsmNodes, ordered from source to
+ *          destination. Each coordinate is snapped to the
+ *          nearest routable node first.
+ *
+ *          @return std::vector<OsmNode>
+*/
+std::vector<OsmNode> Osm::computeRoute(double srcLat, double srcLon, double destLat, double destLon,
+                                       Router::Mode mode)
+{
+    std::shared_ptr<const MapState> map = indexedSnapshot(true, mode == Router::CONTRACTION_HIERARCHY);
+    return routeNodes(map->graph, this->findRoute(*map, srcLat, srcLon, destLat, destLon, mode));
+}
+
+/** \brief  Public function that snaps both coordinates to
+ *          their nearest routable node and finds the route
+ *          between them. The length does not include the
+ *          distance from each coordinate to its node.
+ *
+ *          @return Route
+*/
+Route Osm::findRoute(double srcLat, double srcLon, double destLat, double destLon, Router::Mode mode)
+{
+    return this->findRoute(*indexedSnapshot(true, mode == Router::CONTRACTION_HIERARCHY),
+                           srcLat, srcLon, destLat, destLon, mode);
+}
+
+/** \brief  Finds the route between two coordinates on one
+ *          map version, which must have its spatial index and,
+ *          if mode needs it, a hierarchy.
+ *
+ *          @return Route
+*/
+Route Osm::findRoute(const MapState &map, double srcLat, double srcLon, double destLat, double destLon,
+                     Router::Mode mode)
+{
+    METRICS_PHASE(COMPUTE_ROUTE);
+    uint32_t src = map.spatialIndex.nearest(srcLat, srcLon);
+    uint32_t dest = map.spatialIndex.nearest(destLat, destLon);
+    return this->cachedRoute(map, router, src, dest, mode);
+}
+
+/** \brief  Builds an OsmNode for every node of a route
+ *          found on the map version that g belongs to.
+ *
+ *          @return std::vector<OsmNode>
+*/
+std::vector<OsmNode> Osm::routeNodes(const Graph &g, const Route &found)
+{
     std::vector<OsmNode> route;
-    // find a path between src and dest, then fill route with nodes in the path
-    std::queue<std::string> bfsQue;
-    std::map<std::string, bool> visited;
-    //KEY=CHILD_NODE    VALUE=PARENT_NODE
-    std::map<std::string, std::string> nodeCameFrom;
-    bfsQue.push(srcId);
-    visited[srcId] = true;
-    while(!bfsQue.empty())
-    {
-        std::string currNode = bfsQue.front();
-        bfsQue.pop();
-        if (currNode == destId)
+    route.reserve(found.nodes.size());
+    for (uint32_t node : found.nodes)
+    {
+        route.push_back(OsmNode(std::to_string(g.getID(node)), g.getLat(node), g.getLon(node)));
+    }
+    return route;
+}
+
+/** \brief  Public function that answers a route query
+ *          between graph indices of map from the route cache
+ *          when it holds the route for this profile, mode and
+ *          map version. Otherwise the route is searched for
+ *          with searcher and cached. A CONTRACTION_HIERARCHY
+ *          query on a map without a hierarchy runs, and is
+ *          cached, as BIDIRECTIONAL_DIJKSTRA, which finds a
+ *          route of the same cost. Unreachable pairs are cached
+ *          too, unknown nodes are not. The cache is shared, so
+ *          threads may call this at once with their own Router.
+ *
+ *          @return Route
+*/
+Route Osm::cachedRoute(const MapState &map, Router &searcher, uint32_t src, uint32_t dest,
+                       Router::Mode mode)
+{
+    Route r;
+    if (src >= map.graph.size() || dest >= map.graph.size())
+    {
+        return r;
+    }
+    if (mode == Router::CONTRACTION_HIERARCHY && !map.hierarchy.isBuilt())
+    {
+        mode = Router::BIDIRECTIONAL_DIJKSTRA;
+    }
+    Profile::Type profile = map.graph.getProfile().getType();
+    if (routeCache.find(src, dest, profile, mode, map.version, r))
+    {
+        return r;
+    }
+    if (mode == Router::CONTRACTION_HIERARCHY)
+    {
+        r = searcher.route(map.graph, map.hierarchy, src, dest);
+    }
+    else
+    {
+        r = searcher.route(map.graph, src, dest, mode);
+    }
+    routeCache.insert(src, dest, profile, mode, map.version, r);
+    return r;
+}
+
+/** \brief  Returns the current map version. If it lacks the
+ *          spatial index or the hierarchy and the caller asks
+ *          for it, a copy with the index built is published
+ *          first, under updateLock so that two callers do not
+ *          both build it. The copy keeps the version, since
+ *          its graph is the same, so cached routes stay valid.
+ *
+ *          @return std::shared_ptr<const MapState>
+*/
+std::shared_ptr<const MapState> Osm::indexedSnapshot(bool spatialIndex, bool hierarchy)
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    if ((!spatialIndex || map->spatialIndex.isBuilt()) && (!hierarchy || map->hierarchy.isBuilt()))
+    {
+        return map;
+    }
+    std::lock_guard<std::mutex> hold(updateLock);
+    map = snapshot();
+    bool buildIndex = spatialIndex && !map->spatialIndex.isBuilt();
+    bool buildHierarchy = hierarchy && !map->hierarchy.isBuilt();
+    if (!buildIndex && !buildHierarchy)
+    {
+        return map;
+    }
+    std::shared_ptr<MapState> next = std::make_shared<MapState>(*map);
+    if (buildIndex)
+    {
+        next->spatialIndex.build(next->graph);
+    }
+    if (buildHierarchy)
+    {
+        next->hierarchy.build(next->graph);
+    }
+    std::atomic_store(&state, next);
+    return next;
+}
+
+/** \brief  Public function that returns the graph index of
+ *          the routable node closest to the coordinate,
+ *          building the spatial index if needed.
+ *
+ *          @return uint32_t Graph::NO_NODE if no node has an edge
+*/
+uint32_t Osm::nearestNode(double lat, double lon)
+{
+    return indexedSnapshot(true, false)->spatialIndex.nearest(lat, lon);
+}
+
+/** \brief  Public function that returns up to k routable
+ *          nodes closest to the coordinate, closest first.
+ *
+ *          @return std::vector<uint32_t>
+*/
+std::vector<uint32_t> Osm::nearestNodes(double lat, double lon, size_t k)
+{
+    return indexedSnapshot(true, false)->spatialIndex.nearest(lat, lon, k);
+}
+
+/** \brief  Public function that returns every routable node
+ *          inside the lat/lon box.
+ *
+ *          @return std::vector<uint32_t>
+*/
+std::vector<uint32_t> Osm::nodesInBox(double minLat, double minLon, double maxLat, double maxLon)
+{
+    return indexedSnapshot(true, false)->spatialIndex.inBox(minLat, minLon, maxLat, maxLon);
+}
+
+/** \brief  Public function that builds the k-d tree used to
+ *          snap coordinates to routable nodes.
+ *
+ *          @return void
+*/
+void Osm::buildSpatialIndex()
+{
+    indexedSnapshot(true, false);
+}
+
+/** \brief  Public function that returns the spatial index of
+ *          the current map version. It is empty until
+ *          buildSpatialIndex() or a query by coordinate has
+ *          built it.
+ *
+ *          @return std::shared_ptr<const SpatialIndex>
+*/
+std::shared_ptr<const SpatialIndex> Osm::getSpatialIndex() const
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    return std::shared_ptr<const SpatialIndex>(map, &map->spatialIndex);
+}
+
+/** \brief  Public function that returns the contraction
+ *          hierarchy of the current map version. It is empty
+ *          until buildHierarchy(), loadHierarchy() or a
+ *          CONTRACTION_HIERARCHY query has built it.
+ *
+ *          @return std::shared_ptr<const ContractionHierarchy>
+*/
+std::shared_ptr<const ContractionHierarchy> Osm::getHierarchy() const
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    return std::shared_ptr<const ContractionHierarchy>(map, &map->hierarchy);
+}
+
+/** \brief  Public function that weighs the graph for another
+ *          mode of travel. The contraction hierarchy and the
+ *          spatial index depend on the weights, so the new
+ *          weights go into a new map version that has each of
+ *          them built again if the current version had it.
+ *
+ *          @return void
+*/
+void Osm::setProfile(Profile::Type profile)
+{
+    std::lock_guard<std::mutex> hold(updateLock);
+    std::shared_ptr<const MapState> current = snapshot();
+    std::shared_ptr<MapState> next = std::make_shared<MapState>();
+    next->graph = current->graph;
+    next->graph.setProfile(Profile(profile));
+    next->bounds = current->bounds;
+    if (current->spatialIndex.isBuilt())
+    {
+        next->spatialIndex.build(next->graph);
+    }
+    if (current->hierarchy.isBuilt())
+    {
+        next->hierarchy.build(next->graph);
+    }
+    next->version = RouteCache::nextVersion();
+    std::atomic_store(&state, next);
+}
+
+/** \brief  Public function that returns the cache of routes
+ *          found by findRoute and computeRoute. Its entries
+ *          are tagged with getVersion(), so other users such
+ *          as the route server can share it.
+ *
+ *          @return RouteCache &
+*/
+RouteCache &Osm::getRouteCache()
+{
+    return routeCache;
+}
+
+/** \brief  Public function that returns the version of the
+ *          map. Every Osm starts with a version no other map
+ *          has had, and every applyChange and setProfile moves
+ *          to a new one, so routes cached for another map never
+ *          match it.
+ *
+ *          @return uint64_t
+*/
+uint64_t Osm::getVersion() const
+{
+    return snapshot()->version;
+}
+
+/** \brief  Public function that returns the current map
+ *          version for reading from any thread. applyChange
+ *          swaps in a new version without touching this one,
+ *          which lives on until its last holder lets it go.
+ *
+ *          @return std::shared_ptr<const MapState>
+*/
+std::shared_ptr<const MapState> Osm::snapshot() const
+{
+    return std::atomic_load(&state);
+}
+
+/** \brief  Public function that computes the shortest distance
+ *          from every origin to every destination. Each origin is
+ *          one Dijkstra search that stops once all destinations
+ *          are settled, and origins are shared out over a thread
+ *          pool. Every worker owns its Router, so the graph is
+ *          only read and no locks are taken. When withPaths is
+ *          set the matrix also holds each route as graph indices.
+ *  
+ *          @return DistanceMatrix
+*/
+DistanceMatrix Osm::computeMatrix(const std::vector<std::string> &originIds,
+                                  const std::vector<std::string> &destinationIds,
+                                  bool withPaths, unsigned threads) const
+{
+    DistanceMatrix matrix;
+    matrix.rows = originIds.size();
+    matrix.columns = destinationIds.size();
+    matrix.distances.assign(matrix.rows * matrix.columns, 0);
+    if (withPaths)
+    {
+        matrix.paths.resize(matrix.rows * matrix.columns);
+    }
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    std::vector<uint32_t> origins, destinations;
+    for (const std::string &id : originIds)
+    {
+        origins.push_back(g.indexOf(std::strtoull(id.c_str(), nullptr, 10)));
+    }
+    for (const std::string &id : destinationIds)
+    {
+        destinations.push_back(g.indexOf(std::strtoull(id.c_str(), nullptr, 10)));
+    }
+    ThreadPool pool(std::min<size_t>(threads == 0 ? std::thread::hardware_concurrency() : threads,
+                                     std::max<size_t>(origins.size(), 1)));
+    std::vector<Router> routers(pool.size());
+    pool.parallelFor(origins.size(), [&](unsigned worker, size_t row) {
+        routers[worker].oneToMany(g, origins[row], destinations,
+                                  matrix.distances.data() + row * matrix.columns,
+                                  withPaths ? matrix.paths.data() + row * matrix.columns : nullptr);
+    });
+    return matrix;
+}
+
+/** \brief  Public function that returns every node that
+ *          can be reached from the node id at a cost of at
+ *          most budget, in metres or seconds depending on the
+ *          profile. The result is empty if the id is unknown.
+ *
+ *          @return Isochrone
+*/
+Isochrone Osm::isochrone(const std::string &srcId, double budget)
+{
+    Isochrone reached;
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    router.reachable(g, g.indexOf(std::strtoull(srcId.c_str(), nullptr, 10)), budget, reached);
+    reached.version = map->version;
+    return reached;
+}
+
+/** \brief  Same as isochrone by id, starting from the
+ *          routable node nearest to the coordinate.
+ *
+ *          @return Isochrone
+*/
+Isochrone Osm::isochrone(double lat, double lon, double budget)
+{
+    Isochrone reached;
+    std::shared_ptr<const MapState> map = indexedSnapshot(true, false);
+    router.reachable(map->graph, map->spatialIndex.nearest(lat, lon), budget, reached);
+    reached.version = map->version;
+    return reached;
+}
+
+/** \brief  Public function that computes the isochrone of
+ *          every source id with the same budget. Sources are
+ *          spread over a thread pool and each worker reuses
+ *          the search state of its own Router, so a search
+ *          only pays for the nodes it reaches.
+ *
+ *          @return std::vector<Isochrone> in the order of the ids
+*/
+std::vector<Isochrone> Osm::isochrones(const std::vector<std::string> &sourceIds, double budget,
+                                      unsigned threads) const
+{
+    std::vector<Isochrone> reached(sourceIds.size());
+    ThreadPool pool(std::min<size_t>(threads == 0 ? std::thread::hardware_concurrency() : threads,
+                                     std::max<size_t>(sourceIds.size(), 1)));
+    std::vector<Router> routers(pool.size());
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    pool.parallelFor(sourceIds.size(), [&](unsigned worker, size_t i) {
+        routers[worker].reachable(g, g.indexOf(std::strtoull(sourceIds[i].c_str(), nullptr, 10)),
+                                  budget, reached[i]);
+        reached[i].version = map->version;
+    });
+    return reached;
+}
+
+/** \brief  Public function that runs the contraction hierarchy
+ *          preprocessing on the graph, unless the current map
+ *          version has a hierarchy already, and publishes it
+ *          with that version. It is also run the first time a
+ *          CONTRACTION_HIERARCHY route is requested if no
+ *          hierarchy has been built or loaded.
+ *  
+ *          @return void
+*/
+void Osm::buildHierarchy()
+{
+    indexedSnapshot(false, true);
+}
+
+/** \brief  Public function that saves the contraction hierarchy
+ *          to a file so later runs can load it instead of
+ *          building it again.
+ *  
+ *          @return bool true if the file was written
+*/
+bool Osm::saveHierarchy(const std::string &path) const
+{
+    return snapshot()->hierarchy.save(path);
+}
+
+/** \brief  Public function that loads a contraction hierarchy
+ *          saved by saveHierarchy into a copy of the current map
+ *          version and publishes it. Files built from a
+ *          different map are rejected.
+ *  
+ *          @return bool true if the hierarchy was loaded
+*/
+bool Osm::loadHierarchy(const std::string &path)
+{
+    std::lock_guard<std::mutex> hold(updateLock);
+    std::shared_ptr<const MapState> current = snapshot();
+    ContractionHierarchy hierarchy;
+    if (!hierarchy.load(path, current->graph))
+    {
+        return false;
+    }
+    std::shared_ptr<MapState> next = std::make_shared<MapState>(*current);
+    next->hierarchy = std::move(hierarchy);
+    std::atomic_store(&state, next);
+    return true;
+}
+
+/** \brief  Public function that saves the graph and bounds
+ *          as a binary snapshot. Constructing an Osm from the
+ *          snapshot skips parsing and takes only as long as
+ *          checking its checksums.
+ *  
+ *          @return bool true if the file was written
+*/
+bool Osm::save(const std::string &path) const
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    return map->graph.saveSnapshot(path, map->bounds);
+}
+
+/** \brief  Public function that applies an osmChange file.
+ *          The next map version is built beside the current
+ *          one, which readers holding a snapshot keep using
+ *          meanwhile, and then swapped in. Nodes are merged in
+ *          id order from the current graph and the change, so
+ *          nothing is sorted again, and the edges are laid out
+ *          again from the way table with changed ways replaced,
+ *          deleted ones left out and created ones added at the
+ *          end. No file is parsed but the change itself. The
+ *          spatial index is built again if the current version
+ *          had one, and so is the contraction hierarchy, so
+ *          CONTRACTION_HIERARCHY queries keep using one.
+ *          The bounds only grow, since a deleted node may not
+ *          have been at their edge. In routableOnly maps a new
+ *          way loses the edges to nodes that were dropped when
+ *          the map was read, unless the change also has them.
+ *
+ *          @return bool true if the change was applied
+*/
+bool Osm::applyChange(const std::string &changePath)
+{
+    OsmChange change;
+    if (!updatable || !change.read(changePath))
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> hold(updateLock);
+    std::shared_ptr<const MapState> currentState = snapshot();
+    const MapState &current = *currentState;
+    const Graph &g = current.graph;
+    std::shared_ptr<MapState> next = std::make_shared<MapState>();
+    next->graph.setProfile(g.getProfile());
+    next->bounds = current.bounds;
+    bool firstNode = (g.size() == 0);
+    size_t c = 0;
+    for (uint32_t i = 0; i <= g.size(); i++)
+    {
+        uint64_t id = (i < g.size()) ? g.getID(i) : UINT64_MAX;
+        //Changes to ids below this node are creates, one to this node replaces it
+        for (; c < change.nodes.size() && change.nodes[c].id <= id; c++)
         {
-            std::string parent = currNode;
-            route.push_back(allNodesMap[parent]);
-            visited[parent] = false;
-            while (visited[srcId])
+            const OsmChange::Node &node = change.nodes[c];
+            if (!node.deleted)
             {
-                parent = nodeCameFrom[parent];
-                route.push_back(allNodesMap[parent]);
-                visited[parent] = false;
+                next->graph.addNode(node.id, node.lat, node.lon);
+                extendBounds(next->bounds, node.lat, node.lon, firstNode);
             }
-            return route;
         }
-        for(auto it :adjListMap[currNode])
+        if (i < g.size() && (c == 0 || change.nodes[c - 1].id != id))
         {
-            OsmNode adjNode = it;
-            if (!visited[adjNode.getID()])
-            {
-                visited[adjNode.getID()] = true;
-                bfsQue.push(adjNode.getID());
-                nodeCameFrom[it.getID()] = currNode;
-            }
+            next->graph.addNode(id, g.getLat(i), g.getLon(i));
         }
     }
-    return route;
-}
 
-/** \brief  Initializer function that initializes the adjacency list
- *          by reading through a provided osm file and parsing ways,
- *          setting edges in the adjacency list along the way.
- * 
- *          @return void            
-*/
-void Osm::initializeAdjList()
-{
-    std::string strToParse;
-    std::ifstream osmFile(pathName);
-    //regex for finding beginning and ending of ways, and highways.
-    std::regex matchBegin("^ <way .+>" ,std::regex_constants::ECMAScript);
-    std::regex matchHighways("^  <tag k=\"highway\".+>" ,std::regex_constants::ECMAScript);
-    std::regex matchEnd("^ <\\/way>" ,std::regex_constants::ECMAScript);
-    std::regex matchRefNode("^  <nd ref=\"(.+)\"/>" ,std::regex_constants::ECMAScript);
-    std::smatch match;
-    if (osmFile)
-    {
-        //this->adjList = new std::list<OsmNode>[V];
-        while (std::getline(osmFile,strToParse,'\n'))  //Will loop through all lines in file
-        {   /*ENTERS WAY*/
-            if(std::regex_search(strToParse,match,matchBegin))   // if -> matches begin of way
-            {   //Declare temp vector to hold nodes
-                std::vector<OsmNode> nodeVec;
-                std::getline(osmFile,strToParse,'\n');
-
-                while (std::regex_search(strToParse,match,matchRefNode)) //while->node to grab
-                {
-                    //parse all nodes in way into vector<OsmNode>
-                    nodeVec.push_back(OsmNode(match[1]));
-                    std::getline(osmFile,strToParse,'\n');
-                } 
-                while(!std::regex_search(strToParse,match,matchEnd))//While line is NOT ending way
-                {
-                    if (std::regex_search(strToParse,match,matchHighways))//If line is a highway, add edges
-                    {
-                        OsmNode one, two;
-                        std::vector<OsmNode>::iterator it = nodeVec.begin();
-                        for(size_t i=1; i <=nodeVec.size() && it !=nodeVec.end(); i++, ++it)
-                        {
-                            if ((i % 2) != 0)
-                            {
-                                one = (*it);
-                                if (i != 1)
-                                {
-                                    this->addEdge(one.getID(),two.getID());
-                                }
-                            }
-                            else
-                            {
-                                two = (*it);
-                                this->addEdge(one.getID(),two.getID());
-                            }
-                        }
-                    }
-                    std::getline(osmFile,strToParse,'\n');
-                }
-            }      
+    WayTable nextWays;
+    nextWays.offsets.push_back(0);
+    std::vector<bool> applied(change.ways.size(), false);
+    for (size_t w = 0; w < ways.ids.size(); w++)
+    {
+        const OsmChange::Way *way = change.findWay(ways.ids[w]);
+        if (way == nullptr)
+        {
+            nextWays.ids.push_back(ways.ids[w]);
+            nextWays.attributes.push_back(ways.attributes[w]);
+            nextWays.refs.insert(nextWays.refs.end(), ways.refs.begin() + ways.offsets[w],
+                                 ways.refs.begin() + ways.offsets[w + 1]);
+            nextWays.offsets.push_back(static_cast<uint32_t>(nextWays.refs.size()));
+            continue;
         }
-    }        
+        applied[way - change.ways.data()] = true;
+        if (!way->deleted)
+        {
+            nextWays.ids.push_back(way->id);
+            nextWays.attributes.push_back(way->attributes);
+            nextWays.refs.insert(nextWays.refs.end(), way->refs.begin(), way->refs.end());
+            nextWays.offsets.push_back(static_cast<uint32_t>(nextWays.refs.size()));
+        }
+    }
+    for (size_t w = 0; w < change.ways.size(); w++)
+    {
+        if (!applied[w] && !change.ways[w].deleted)
+        {
+            nextWays.ids.push_back(change.ways[w].id);
+            nextWays.attributes.push_back(change.ways[w].attributes);
+            nextWays.refs.insert(nextWays.refs.end(), change.ways[w].refs.begin(), change.ways[w].refs.end());
+            nextWays.offsets.push_back(static_cast<uint32_t>(nextWays.refs.size()));
+        }
+    }
+    for (size_t w = 0; w < nextWays.ids.size(); w++)
+    {
+        METRICS_COUNT(EDGES_ADDED, nextWays.offsets[w + 1] - nextWays.offsets[w] - 1);
+        for (uint32_t r = nextWays.offsets[w] + 1; r < nextWays.offsets[w + 1]; r++)
+        {
+            next->graph.addEdge(nextWays.refs[r - 1], nextWays.refs[r], nextWays.attributes[w]);
+        }
+    }
+    {
+        METRICS_PHASE(OSM_BUILD_GRAPH);
+        next->graph.build();
+    }
+    if (current.spatialIndex.isBuilt())
+    {
+        next->spatialIndex.build(next->graph);
+    }
+    if (current.hierarchy.isBuilt())
+    {
+        next->hierarchy.build(next->graph);
+    }
+    next->version = RouteCache::nextVersion();
+    std::atomic_store(&state, next);
+    ways = std::move(nextWays);
+    return true;
 }
 
-/** \brief  Function to be called by constructor that will
- * 	        parse through a provided Osm file and store all
- * 	        the node in an unordered_map<std::string,OsmNode>.
- * 	     
- *	        @return void
- */
-void Osm::parseNodes()
+/** \brief  Initializer function that maps the Osm file into memory
+ *          and reads it in one pass over the whole file. Every
+ *          node is added to the graph while the bounds are
+ *          tracked, and every way tagged as a highway adds an
+ *          edge between each pair of consecutive node refs.
+ *          The file is read in chunks on up to threads
+ *          workers, and the chunks are merged in file order so
+ *          the graph is the same for any thread count. The
+ *          graph is built once the whole file has been read.
+ *
+ *          @return void
+*/
+void Osm::parseOsm(unsigned threads)
 {
-    std::string strToParse;
-    std::ifstream osmFile(pathName);
-
-    std::regex nodeReader("^ <node id=\"([0-9]*)\" .+ lat=\"(.+)\" lon=\"(.+)\"/?",std::regex_constants::ECMAScript);
-    std::smatch match;
-
-    if (osmFile)
-    { 
-        double minLatTemp, maxLatTemp,minLonTemp, maxLonTemp;
-        while (std::getline(osmFile,strToParse,'\n'))
+    MappedFile osmFile(pathName);
+    if (!osmFile.isOpen())
+    {
+        return;
+    }
+    bool firstNode = true;
+    scanChunks(osmFile, threads, ChunkScan::NODES_AND_WAYS, [this, &firstNode](ChunkScan &chunk) {
+        mergeChunkNodes(chunk, firstNode);
+        mergeChunkWays(chunk);
+        METRICS_COUNT(EDGES_ADDED, chunk.edges.size());
+        for (size_t e = 0; e < chunk.edges.size(); e++)
         {
-            if(std::regex_search(strToParse,match,nodeReader))
+            state->graph.addEdge(chunk.edges[e].first, chunk.edges[e].second, chunk.edgeAttributes[e]);
+        }
+    });
+    {
+        METRICS_PHASE(OSM_BUILD_GRAPH);
+        state->graph.build();
+    }
+}
+
+/** \brief  Initializer function for routableOnly loads, in
+ *          three passes that each read chunks on up to threads
+ *          workers. The first reads only the ways and adds the
+ *          node refs of highways to an IdCollector, which holds
+ *          memoryBudget bytes of them and spills the rest to
+ *          disk as sorted runs. The second reads the nodes and
+ *          keeps those the collector has, looking each chunk's
+ *          ids up in increasing order while the runs are merged
+ *          a block at a time, so the set of used ids is never
+ *          in memory as a whole. The bounds still cover every
+ *          node in the file. The third reads the ways again for
+ *          their edges, which only go into the graph once the
+ *          collector is gone. The graph itself, and the way
+ *          table of updatable loads, are not counted against
+ *          memoryBudget.
+ *
+ *          @return void
+*/
+void Osm::parseRoutable(size_t memoryBudget, unsigned threads)
+{
+    MappedFile osmFile(pathName);
+    if (!osmFile.isOpen())
+    {
+        return;
+    }
+    {
+        IdCollector refs(memoryBudget);
+        scanChunks(osmFile, threads, ChunkScan::WAYS, [&refs](ChunkScan &chunk) {
+            for (uint64_t ref : chunk.refs)
+            {
+                refs.add(ref);
+            }
+        });
+        //If a spilled run cannot be read back every node is kept instead
+        bool keepAll = !refs.finish();
+        bool firstNode = true;
+        std::vector<uint32_t> order;
+        std::vector<char> used;
+        scanChunks(osmFile, threads, ChunkScan::NODES, [&](ChunkScan &chunk) {
+            if (!keepAll)
             {
-                minLatTemp=std::stod(match[2]);
-                minLonTemp=std::stod(match[3]);
-                maxLatTemp=std::stod(match[2]);
-                maxLonTemp=std::stod(match[3]);
-                allNodesMap.insert(std::make_pair(match[1],OsmNode(match[1],maxLatTemp, maxLonTemp)));
-                break;
+                keepCollected(chunk, refs, order, used);
             }
+            mergeChunkNodes(chunk, firstNode);
+        });
+    }
+    scanChunks(osmFile, threads, ChunkScan::WAYS, [this](ChunkScan &chunk) {
+        mergeChunkWays(chunk);
+        METRICS_COUNT(EDGES_ADDED, chunk.edges.size());
+        for (size_t e = 0; e < chunk.edges.size(); e++)
+        {
+            state->graph.addEdge(chunk.edges[e].first, chunk.edges[e].second, chunk.edgeAttributes[e]);
         }
-        while (std::getline(osmFile,strToParse,'\n'))  //Will loop through all lines in file
+    });
+    {
+        METRICS_PHASE(OSM_BUILD_GRAPH);
+        state->graph.build();
+    }
+}
+
+/** \brief  Splits the mapped file into chunks of about
+ *          ChunkScan::CHUNK_BYTES that each start at a node, way or
+ *          relation element at the beginning of a line, so no
+ *          element is cut in two. Chunks are scanned a wave at
+ *          a time, one wave being as many chunks as there are
+ *          workers, and merge is called on each scanned chunk
+ *          in file order before the next wave starts. That
+ *          keeps the parsed but unmerged data to one wave. A
+ *          file of one chunk, or a threads value of 1, is
+ *          scanned on the calling thread. PBF files are split
+ *          at blob boundaries instead, and InvalidPbf is
+ *          thrown if one cannot be decoded.
+ *
+ *          @return void
+*/
+void Osm::scanChunks(const MappedFile &osmFile, unsigned threads, ChunkScan::Kind kind,
+                     const std::function<void(ChunkScan &)> &merge)
+{
+    METRICS_PHASE(OSM_PARSE);
+    bool pbf = PbfReader::isPbf(osmFile.begin(), osmFile.end());
+    std::vector<const char *> starts;
+    if (!pbf)
+    {
+        starts = ChunkScan::split(osmFile.begin(), osmFile.end());
+    }
+    else if (!PbfReader::split(osmFile.begin(), osmFile.end(), starts))
+    {
+        throw InvalidPbf();
+    }
+    starts.push_back(osmFile.end());
+    size_t chunks = starts.size() - 1;
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    threads = static_cast<unsigned>(std::max<size_t>(std::min<size_t>(threads, chunks), 1));
+    std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads) : nullptr);
+    std::vector<ChunkScan> wave(threads);
+    std::vector<char> decoded(threads);
+    auto scanOne = [&](size_t i, size_t chunk) {
+        if (pbf)
+        {
+            decoded[i] = PbfReader::scan(starts[chunk], starts[chunk + 1], wave[i]);
+        }
+        else
+        {
+            wave[i].scan(starts[chunk], starts[chunk + 1]);
+            decoded[i] = true;
+        }
+    };
+    for (size_t first = 0; first < chunks; first += threads)
+    {
+        size_t count = std::min<size_t>(threads, chunks - first);
+        for (size_t i = 0; i < count; i++)
+        {
+            wave[i].reset(kind);
+        }
+        if (pool)
+        {
+            pool->parallelFor(count, [&](unsigned, size_t i) { scanOne(i, first + i); });
+        }
+        else
+        {
+            scanOne(0, first);
+        }
+        for (size_t i = 0; i < count; i++)
         {
-            if(std::regex_search(strToParse,match,nodeReader))   // if -> Matches a node formatted line
+            if (!decoded[i])
             {
-                double lat, lon;
-                lat=std::stod(match[2]);
-                lon=std::stod(match[3]);
-                if (lat < minLatTemp)
-                {
-                    minLatTemp= lat;
-                }
-                else if (lat > maxLatTemp)
-                {
-                    maxLatTemp= lat;
-                }
-                if (lon < minLonTemp)
-                {
-                    minLonTemp= lon;
-                }
-                else if (lon > maxLonTemp)
-                {
-                    maxLonTemp= lon;
-                }
-                allNodesMap.insert(std::make_pair(match[1],OsmNode(match[1],lat, lon)));
+                throw InvalidPbf();
             }
+            merge(wave[i]);
+        }
+    }
+}
+
+/** \brief  Adds the nodes of a scanned chunk to the graph and
+ *          folds the chunk's bounds into the map bounds.
+ *
+ *          @return void
+*/
+void Osm::mergeChunkNodes(const ChunkScan &chunk, bool &firstNode)
+{
+    if (chunk.hasNode)
+    {
+        extendBounds(state->bounds, chunk.minLat, chunk.minLon, firstNode);
+        extendBounds(state->bounds, chunk.maxLat, chunk.maxLon, firstNode);
+    }
+    for (size_t i = 0; i < chunk.ids.size(); i++)
+    {
+        state->graph.addNode(chunk.ids[i], chunk.lats[i], chunk.lons[i]);
+    }
+}
+
+/** \brief  Adds the highway ways of a scanned chunk to the
+ *          way table when the map is updatable. Each way's refs
+ *          are read back from its edges, which are consecutive.
+ *
+ *          @return void
+*/
+void Osm::mergeChunkWays(const ChunkScan &chunk)
+{
+    if (!updatable)
+    {
+        return;
+    }
+    if (ways.offsets.empty())
+    {
+        ways.offsets.push_back(0);
+    }
+    size_t e = 0;
+    for (size_t w = 0; w < chunk.wayIds.size(); w++)
+    {
+        ways.ids.push_back(chunk.wayIds[w]);
+        ways.attributes.push_back(chunk.edgeAttributes[e]);
+        ways.refs.push_back(chunk.edges[e].first);
+        for (uint32_t i = 0; i < chunk.wayEdges[w]; i++, e++)
+        {
+            ways.refs.push_back(chunk.edges[e].second);
         }
-        this->minLat=minLatTemp;
-        this->minLon=minLonTemp;
-        this->maxLat=maxLatTemp;
-        this->maxLon=maxLonTemp;
+        ways.offsets.push_back(static_cast<uint32_t>(ways.refs.size()));
+    }
+}
+
+/** \brief  Grows the bounds to take in the given coordinate.
+ *          The first node sets all four bounds.
+ *
+ *          @return void
+*/
+void Osm::extendBounds(Graph::Bounds &bounds, double lat, double lon, bool &firstNode)
+{
+    if (firstNode)
+    {
+        bounds.minLat = bounds.maxLat = lat;
+        bounds.minLon = bounds.maxLon = lon;
+        firstNode = false;
+    }
+    else
+    {
+        if (lat < bounds.minLat) bounds.minLat = lat;
+        else if (lat > bounds.maxLat) bounds.maxLat = lat;
+        if (lon < bounds.minLon) bounds.minLon = lon;
+        else if (lon > bounds.maxLon) bounds.maxLon = lon;
     }
 }
 
-/** \brief  This is a initializer function that will be used when
- * 	        initializing adjacency list. It takes 2 strings
- * 	        as parameters and adds both nodes to each others
- * 	        adjacency list within the current Osm object.
+/** \brief  Public helper that builds an OsmNode, with its id
+ * 	        as a string, for the node at the given graph index.
  * 	     
- *	        @return void
+ *	        @return OsmNode
  */
-void Osm::addEdge(std::string adjOneID, std::string adjTwoID)
-{           
-/*
+OsmNode Osm::getNode(uint32_t index) const
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    return OsmNode(std::to_string(g.getID(index)), g.getLat(index), g.getLon(index));
+}
+
+/** \brief  Function that returns the graph of the current
+ *          map version, for callers that work with node indices.
+ *          The map version lives as long as the pointer does.
+ * 
+ *          @return std::shared_ptr<const Graph>
 */
-    OsmNode one=allNodesMap[adjOneID];
-    OsmNode two=allNodesMap[adjTwoID];
-    adjListMap[adjOneID].push_back(two);
-    adjListMap[adjTwoID].push_back(one);
+std::shared_ptr<const Graph> Osm::getGraph() const
+{
+    std::shared_ptr<const MapState> map = snapshot();
+    return std::shared_ptr<const Graph>(map, &map->graph);
 }
 
 /** \brief  Function that returns the current Osm
@@ -215,7 +958,7 @@ void Osm::addEdge(std::string adjOneID, std::string adjTwoID)
 */
 double Osm::get_MIN_LAT() const
 {
-    return this->minLat;
+    return snapshot()->bounds.minLat;
 }
 
 /** \brief  Function that returns the current Osm
@@ -225,7 +968,7 @@ double Osm::get_MIN_LAT() const
 */
 double Osm::get_MAX_LAT() const
 {
-    return this->maxLat;
+    return snapshot()->bounds.maxLat;
 }
 
 /** \brief  Function that returns the current Osm
@@ -235,7 +978,7 @@ double Osm::get_MAX_LAT() const
 */
 double Osm::get_MIN_LON() const
 {
-    return this->minLon;
+    return snapshot()->bounds.minLon;
 }
 
 /** \brief  Function that returns the current Osm
@@ -245,44 +988,86 @@ double Osm::get_MIN_LON() const
 */
 double Osm::get_MAX_LON() const
 {
-    return this->maxLon;
+    return snapshot()->bounds.maxLon;
+}
+
+
+/** \brief  Public function that returns a view of every
+ *          node of the graph, in graph index order, read in
+ *          place without copying.
+ *
+ *          @return NodeRange
+*/
+NodeRange Osm::nodes() const
+{
+    return NodeRange(getGraph());
+}
+
+/** \brief  Public function that returns a view of the node
+ *          with the given graph index.
+ *
+ *          @return NodeView
+*/
+NodeView Osm::node(uint32_t index) const
+{
+    return NodeView(getGraph(), index);
 }
 
+/** \brief  Public function that returns a view of the
+ *          neighbors of the node with the given graph index.
+ *
+ *          @return NeighborView
+*/
+NeighborView Osm::neighbors(uint32_t index) const
+{
+    return NeighborView(getGraph(), index);
+}
 
-/** \brief  This is a public helper function to be used in
- * 	        Image class which allows an unordered_map
- *	        to be passed in as a parameter so the function
- * 	        can populate the map with the contents of the
- *   	    allNodesMap containing all the nodes.
+/** \brief  This is a public helper function which allows
+ *	        an unordered_map to be passed in as a parameter so
+ *	        the function can populate the map with a copy of
+ * 	        every node in the graph. Deprecated, nodes() reads
+ * 	        the same nodes without copying them.
  * 	     
  *	        @return void
  */
 void Osm::popNodeMap(std::unordered_map<std::string, OsmNode> &a)
 {
-    for(auto it = allNodesMap.begin(); it != allNodesMap.end(); ++it)
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    a.reserve(a.size() + g.size());
+    for (uint32_t i = 0; i < g.size(); i++)
     {
-        std::string id =it->first;
-        OsmNode node =it->second;
-        a.insert(std::make_pair(id,node));
+        OsmNode node(std::to_string(g.getID(i)), g.getLat(i), g.getLon(i));
+        a.insert(std::make_pair(node.getID(), node));
     }   
 }
 
-/** \brief  This is a  public helper function to be used in
- * 	        Image class which allows an unordered_map
- *	        to be passed in as a parameter so the function
- * 	        can populate the map with the contents of the
- *   	    adjListMap containing all the nodes and each
- * 	        node that is adjacent to it.
+/** \brief  This is a  public helper function which allows
+ *	        an unordered_map to be passed in as a parameter so
+ *	        the function can populate the map with a copy of the
+ *   	    adjacency list, containing all the nodes with at
+ * 	        least one edge and each node that is adjacent to it.
+ * 	        Deprecated, neighbors() reads the same lists in place.
  * 	     
  *	        @return void
  */
 void Osm::popAdjList(std::unordered_map<std::string, std::vector<OsmNode>> &a)
 {
-    for(auto it =adjListMap.begin(); it != adjListMap.end(); ++it)
+    std::shared_ptr<const MapState> map = snapshot();
+    const Graph &g = map->graph;
+    for (uint32_t i = 0; i < g.size(); i++)
     {
-        std::string id =it->first;
-        std::vector<OsmNode> nodeList =it->second;
-        a.insert(std::make_pair(id,nodeList));
+        if (g.degree(i) == 0)
+        {
+            continue;
+        }
+        std::vector<OsmNode> nodeList;
+        nodeList.reserve(g.degree(i));
+        for (uint32_t adj : g.neighbors(i))
+        {
+            nodeList.push_back(OsmNode(std::to_string(g.getID(adj)), g.getLat(adj), g.getLon(adj)));
+        }
+        a.insert(std::make_pair(std::to_string(g.getID(i)), nodeList));
     }
 }
-
@@ -8,33 +8,166 @@
 #include <vector>
 #include <list>
 #include <unordered_map>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include "osmnode.hpp"
+#include "graph.hpp"
+#include "graphview.hpp"
+#include "router.hpp"
+#include "chunkscan.hpp"
+#include "spatialindex.hpp"
+#include "routecache.hpp"
+
+class MappedFile;
+
+// How the constructor reads an .osm file
+struct OsmLoadOptions {
+    bool routableOnly;      /** Keep only the nodes used by highway ways. */
+    size_t memoryBudget;    /** Bytes of way refs a routableOnly load holds before spilling sorted runs to disk. */
+    unsigned threads;       /** Parser threads, 0 for one per core. */
+    Profile::Type profile;  /** Mode of travel the arcs are weighted for. */
+    size_t routeCacheSize;  /** Routes kept for repeated queries, 0 to cache none. */
+    bool updatable;         /** Keep the highway ways so applyChange can patch the map. */
+    OsmLoadOptions() : routableOnly(false), memoryBudget(size_t(256) << 20), threads(0),
+                       profile(Profile::DISTANCE), routeCacheSize(4096), updatable(false) {}
+};
+
+// One version of the loaded map. A published version is never changed:
+// applyChange, setProfile and the builds of the spatial index and the
+// hierarchy make the next one beside it and swap it in, so a reader
+// holding a snapshot sees the same graph, indexes and bounds throughout.
+struct MapState {
+    Graph graph;
+    ContractionHierarchy hierarchy;
+    SpatialIndex spatialIndex;
+    Graph::Bounds bounds;
+    uint64_t version;       /** Unique to this map version, see RouteCache. */
+    MapState() : version(0) { bounds.minLat = bounds.minLon = bounds.maxLat = bounds.maxLon = 0; }
+};
 
 class Osm {
     private:
+        // Highway ways in file order, the refs of way w being
+        // refs[offsets[w]] .. refs[offsets[w+1]-1]
+        struct WayTable {
+            std::vector<uint64_t> ids;
+            std::vector<uint32_t> offsets;
+            std::vector<uint64_t> refs;
+            std::vector<EdgeAttributes> attributes;
+        };
+
         std::string pathName;
-        double minLat, minLon, maxLat, maxLon;
-        std::unordered_map<std::string, OsmNode> allNodesMap;
-        std::unordered_map<std::string, std::vector<OsmNode>> adjListMap;
-
-        //Will parse ways and add each edge to adjListMap
-        void initializeAdjList();
-        //Function used to add an edge in the adjacency list
-        void addEdge(std::string adjOneID, std::string adjTwoID);
-        //parses nodes into unordered map
-        void parseNodes();
+        //Current map: graph indexed by dense node index, the hierarchy and
+        //spatial index built on demand for it, its bounds and version. Only
+        //the constructor writes it in place; after that it is read with
+        //snapshot() and replaced with std::atomic_store under updateLock.
+        std::shared_ptr<MapState> state;
+        //Search state reused between route queries
+        Router router;
+        //Routes already found, tagged with the map version they were found on
+        RouteCache routeCache;
+        //Kept by updatable loads, so applyChange can lay out the edges again
+        bool updatable;
+        WayTable ways;
+        //Held while a new map version is made, so they are made one at a time
+        std::mutex updateLock;
+
+        //parses nodes and highway ways into the graph in one pass
+        void parseOsm(unsigned threads);
+        //parses the refs of highway ways, then only the nodes they use, then the ways' edges
+        void parseRoutable(size_t memoryBudget, unsigned threads);
+        //scans the file in chunks on a thread pool, merging them in file order
+        void scanChunks(const MappedFile &osmFile, unsigned threads, ChunkScan::Kind kind,
+                        const std::function<void(ChunkScan &)> &merge);
+        void mergeChunkNodes(const ChunkScan &chunk, bool &firstNode);
+        //adds the highway ways of a chunk to the way table of updatable loads
+        void mergeChunkWays(const ChunkScan &chunk);
+        //grows the bounds to include a node, starting them at the first one
+        static void extendBounds(Graph::Bounds &bounds, double lat, double lon, bool &firstNode);
+        //the current map, first publishing a version with the spatial index
+        //or the hierarchy built if it is asked for and missing
+        std::shared_ptr<const MapState> indexedSnapshot(bool spatialIndex, bool hierarchy);
+        //routes on one map version, so the indices of the route belong to it
+        Route findRoute(const MapState &map, const std::string &srcId, const std::string &destId,
+                        Router::Mode mode);
+        Route findRoute(const MapState &map, double srcLat, double srcLon, double destLat, double destLon,
+                        Router::Mode mode);
+        static std::vector<OsmNode> routeNodes(const Graph &g, const Route &route);
     public:
-        Osm(const std::string &);
+        // Thrown when a snapshot file is stale or damaged
+        class InvalidSnapshot {};
+        // Thrown when a PBF file is damaged or uses unsupported features
+        class InvalidPbf {};
+        // Reads an .osm or .osm.pbf file, or maps a snapshot written by save()
+        Osm(const std::string &, const OsmLoadOptions &options = OsmLoadOptions());
         double get_MIN_LAT() const;
         double get_MAX_LAT() const;
         double get_MIN_LON() const;
         double get_MAX_LON() const;
-        void popNodeMap(std::unordered_map<std::string, OsmNode> &a);
-        void popAdjList(std::unordered_map<std::string, std::vector<OsmNode>> &a);
+        // Deprecated: these copy the whole graph into string keyed maps.
+        // Walk nodes(), node(i) and neighbors(i) instead, which read it in place.
+        void popNodeMap(std::unordered_map<std::string, OsmNode> &a) __attribute__((deprecated));
+        void popAdjList(std::unordered_map<std::string, std::vector<OsmNode>> &a) __attribute__((deprecated));
+        OsmNode getNode(uint32_t index) const;
+        // Read-only views of the current graph. Each view shares ownership
+        // of the map version it was made from, so it stays valid, and keeps
+        // reading that version, after applyChange or setProfile replace it.
+        NodeRange nodes() const;
+        NodeView node(uint32_t index) const;
+        NeighborView neighbors(uint32_t index) const;
+        std::shared_ptr<const Graph> getGraph() const;
         // Path finding
         // The two parameters are nodeid, you can use other data types if it works
-        std::vector<OsmNode> computeRoute(const std::string &, const std::string &) ;
-        
+        std::vector<OsmNode> computeRoute(const std::string &, const std::string &, Router::Mode mode = Router::ASTAR);
+        // Path finding that also reports the length, route nodes are graph indices
+        Route findRoute(const std::string &, const std::string &, Router::Mode mode = Router::ASTAR);
+        // Path finding between two lat/lon pairs, each snapped to the nearest routable node
+        std::vector<OsmNode> computeRoute(double, double, double, double, Router::Mode mode = Router::ASTAR);
+        Route findRoute(double, double, double, double, Router::Mode mode = Router::ASTAR);
+        // Routable nodes near a coordinate or inside a lat/lon box, as graph indices
+        uint32_t nearestNode(double lat, double lon);
+        std::vector<uint32_t> nearestNodes(double lat, double lon, size_t k);
+        std::vector<uint32_t> nodesInBox(double minLat, double minLon, double maxLat, double maxLon);
+        void buildSpatialIndex();
+        // Indexes built by buildSpatialIndex and buildHierarchy, for read-only use from
+        // several threads, sharing ownership of their map version like the views above
+        std::shared_ptr<const SpatialIndex> getSpatialIndex() const;
+        std::shared_ptr<const ContractionHierarchy> getHierarchy() const;
+        // Weighs the arcs for another mode of travel
+        void setProfile(Profile::Type profile);
+        // Routes found by findRoute and computeRoute, safe to share between threads
+        RouteCache &getRouteCache();
+        // Route between graph indices of map from the route cache, or searched with
+        // router and cached. CONTRACTION_HIERARCHY runs as BIDIRECTIONAL_DIJKSTRA if
+        // map has no hierarchy. Safe from several threads, each with its own router.
+        Route cachedRoute(const MapState &map, Router &searcher, uint32_t src, uint32_t dest,
+                          Router::Mode mode);
+        uint64_t getVersion() const;
+        // The current map version, kept alive and unchanged for as long as the
+        // caller holds it. Several reads that must agree, such as a route and
+        // the nodes it names, should share one snapshot.
+        std::shared_ptr<const MapState> snapshot() const;
+        // Applies the creates, modifies and deletes of nodes and ways in an
+        // osmChange (.osc) file. False, with the map unchanged, if the file
+        // cannot be read or the map was not loaded with options.updatable.
+        bool applyChange(const std::string &);
+        // Distances between every origin and destination id, computed on threads workers (0 = all cores)
+        DistanceMatrix computeMatrix(const std::vector<std::string> &, const std::vector<std::string> &,
+                                     bool withPaths = false, unsigned threads = 0) const;
+        // Nodes reachable from a node id or a snapped coordinate within a cost budget
+        Isochrone isochrone(const std::string &, double budget);
+        Isochrone isochrone(double lat, double lon, double budget);
+        // One isochrone per source id, computed on threads workers (0 = all cores)
+        std::vector<Isochrone> isochrones(const std::vector<std::string> &, double budget,
+                                          unsigned threads = 0) const;
+        // Contraction hierarchy preprocessing for fast repeated queries
+        void buildHierarchy();
+        bool saveHierarchy(const std::string &) const;
+        bool loadHierarchy(const std::string &);
+        // Writes a snapshot of the graph and bounds that the constructor can map
+        bool save(const std::string &) const;
+
 };
 
 #endif
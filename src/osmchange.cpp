@@ -0,0 +1,189 @@
+/**
+ * @brief OsmChange Class implementation
+ */
+
+#include "osmchange.hpp"
+#include "osmscanner.hpp"
+#include "mappedfile.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    /** \brief  Sorts the changes by id, keeping the order of
+     *          changes to the same id, then keeps only the last
+     *          change of each id.
+     *
+     *          @return void
+    */
+    template <typename Change>
+    void keepLastChanges(std::vector<Change> &changes)
+    {
+        std::stable_sort(changes.begin(), changes.end(),
+            [](const Change &a, const Change &b) { return a.id < b.id; });
+        size_t kept = 0;
+        for (size_t i = 0; i < changes.size(); i++)
+        {
+            if (i + 1 < changes.size() && changes[i + 1].id == changes[i].id)
+            {
+                continue;
+            }
+            if (kept != i)
+            {
+                changes[kept] = std::move(changes[i]);
+            }
+            kept++;
+        }
+        changes.resize(kept);
+    }
+
+    /** \brief  Binary search of changes sorted by id.
+     *
+     *          @return const Change * null if id is not there
+    */
+    template <typename Change>
+    const Change *findChange(const std::vector<Change> &changes, uint64_t id)
+    {
+        auto it = std::lower_bound(changes.begin(), changes.end(), id,
+            [](const Change &change, uint64_t value) { return change.id < value; });
+        return (it == changes.end() || it->id != id) ? nullptr : &*it;
+    }
+}
+
+/** \brief  Maps the file and reads its changes. The file must
+ *          have an osmChange element near its start, so a full
+ *          .osm file is not taken for a change by mistake.
+ *
+ *          @return bool true if the file was read
+*/
+bool OsmChange::read(const std::string &path)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        return false;
+    }
+    const char *head = file.begin();
+    size_t headBytes = std::min<size_t>(file.end() - file.begin(), 4096);
+    const char *tag = "<osmChange";
+    if (std::search(head, head + headBytes, tag, tag + std::strlen(tag)) == head + headBytes)
+    {
+        return false;
+    }
+    scan(file.begin(), file.end());
+    return true;
+}
+
+/** \brief  Reads the node and way elements inside the create,
+ *          modify and delete sections of [begin, end). Nodes
+ *          and ways outside of a section are ignored. Deleted
+ *          elements need only their id.
+ *
+ *          @return void
+*/
+void OsmChange::scan(const char *begin, const char *end)
+{
+    OsmScanner scanner(begin, end);
+    OsmScanner::Span id, lat, lon, key, value;
+    OsmScanner::Element section = OsmScanner::OTHER;
+    WayTags tags;
+    Way way;
+    bool inWay = false;
+    OsmScanner::Element element;
+    while ((element = scanner.next()) != OsmScanner::DONE)
+    {
+        switch (element)
+        {
+            case OsmScanner::CREATE:
+            case OsmScanner::MODIFY:
+            case OsmScanner::DELETE:
+                section = element;
+                break;
+            case OsmScanner::SECTION_END:
+                section = OsmScanner::OTHER;
+                break;
+            case OsmScanner::NODE:
+                if (section != OsmScanner::OTHER && scanner.getAttribute("id", id))
+                {
+                    Node node;
+                    node.id = id.toId();
+                    node.deleted = (section == OsmScanner::DELETE);
+                    node.lat = node.lon = 0;
+                    if (!node.deleted)
+                    {
+                        if (!scanner.getAttribute("lat", lat) || !scanner.getAttribute("lon", lon))
+                        {
+                            break;
+                        }
+                        node.lat = lat.toDouble();
+                        node.lon = lon.toDouble();
+                    }
+                    nodes.push_back(node);
+                }
+                break;
+            case OsmScanner::WAY:
+                inWay = (section != OsmScanner::OTHER && scanner.getAttribute("id", id));
+                if (inWay)
+                {
+                    way.id = id.toId();
+                    way.deleted = (section == OsmScanner::DELETE);
+                    way.refs.clear();
+                    tags.clear();
+                    if (scanner.isSelfClosing())
+                    {
+                        //A way with no refs or tags is no highway
+                        way.deleted = true;
+                        ways.push_back(way);
+                        inWay = false;
+                    }
+                }
+                break;
+            case OsmScanner::ND:
+                if (inWay && scanner.getAttribute("ref", id))
+                {
+                    way.refs.push_back(id.toId());
+                }
+                break;
+            case OsmScanner::TAG:
+                if (inWay && scanner.getAttribute("k", key) && scanner.getAttribute("v", value))
+                {
+                    tags.add(key.begin, key.end - key.begin, value.begin, value.end - value.begin);
+                }
+                break;
+            case OsmScanner::WAY_END:
+                if (inWay)
+                {
+                    way.deleted = way.deleted || !tags.isHighway() || way.refs.size() < 2;
+                    way.attributes = tags.finish();
+                    if (way.deleted)
+                    {
+                        way.refs.clear();
+                    }
+                    ways.push_back(way);
+                }
+                inWay = false;
+                break;
+            default:
+                break;
+        }
+    }
+    keepLastChanges(nodes);
+    keepLastChanges(ways);
+}
+
+/** \brief  Returns the change of the node with the given id.
+ *
+ *          @return const OsmChange::Node * null if it is unchanged
+*/
+const OsmChange::Node *OsmChange::findNode(uint64_t id) const
+{
+    return findChange(nodes, id);
+}
+
+/** \brief  Returns the change of the way with the given id.
+ *
+ *          @return const OsmChange::Way * null if it is unchanged
+*/
+const OsmChange::Way *OsmChange::findWay(uint64_t id) const
+{
+    return findChange(ways, id);
+}
@@ -0,0 +1,45 @@
+/**
+ * @brief OsmChange Class header
+ */
+#ifndef OSMCHANGE_H
+#define OSMCHANGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "profile.hpp"
+
+// The nodes and ways named by an osmChange (.osc) file, each in the
+// state the file leaves it in. An element changed more than once keeps
+// only its last change, as applying the changes in order would.
+struct OsmChange {
+    // A node created or modified with these coordinates, or deleted
+    struct Node {
+        uint64_t id;
+        bool deleted;
+        double lat, lon;
+    };
+    // A way created or modified with these refs and attributes, or
+    // deleted. A way that is not a highway is treated as deleted, since
+    // only highways are part of the map.
+    struct Way {
+        uint64_t id;
+        bool deleted;
+        std::vector<uint64_t> refs;
+        EdgeAttributes attributes;
+    };
+
+    std::vector<Node> nodes;    /** Sorted by id, one per id. */
+    std::vector<Way> ways;      /** Sorted by id, one per id. */
+
+    // Reads an osmChange file, false if it cannot be opened or has no osmChange element
+    bool read(const std::string &path);
+    // Reads the osmChange elements in [begin, end)
+    void scan(const char *begin, const char *end);
+    // Node or way change with the given id, or null if the file does not change it
+    const Node *findNode(uint64_t id) const;
+    const Way *findWay(uint64_t id) const;
+};
+
+#endif
@@ -0,0 +1,253 @@
+/**
+ * @brief OsmScanner Class implementation
+ */
+
+#include "osmscanner.hpp"
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+    /** \brief  True for the whitespace characters allowed
+     *          between XML attributes.
+    */
+    inline bool isSpace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    /** \brief  Compares the element name in [b, e) to a
+     *          null terminated literal.
+    */
+    inline bool nameIs(const char *b, const char *e, const char *lit)
+    {
+        size_t n = std::strlen(lit);
+        return static_cast<size_t>(e - b) == n && std::memcmp(b, lit, n) == 0;
+    }
+
+    /** \brief  Finds the first occurrence of the null terminated
+     *          string pat in [b, e), or returns e.
+    */
+    const char *findSeq(const char *b, const char *e, const char *pat)
+    {
+        size_t n = std::strlen(pat);
+        while (b < e)
+        {
+            const char *p = static_cast<const char *>(std::memchr(b, pat[0], e - b));
+            if (p == nullptr || static_cast<size_t>(e - p) < n)
+            {
+                return e;
+            }
+            if (std::memcmp(p, pat, n) == 0)
+            {
+                return p;
+            }
+            b = p + 1;
+        }
+        return e;
+    }
+}
+
+/** \brief  Returns true if the span holds exactly the
+ *          given null terminated string.
+ *
+ *          @return bool
+*/
+bool OsmScanner::Span::equals(const char *lit) const
+{
+    return nameIs(begin, end, lit);
+}
+
+/** \brief  Converts the span, which holds a decimal OSM id,
+ *          into an unsigned 64-bit integer.
+ *
+ *          @return uint64_t
+*/
+uint64_t OsmScanner::Span::toId() const
+{
+    uint64_t id = 0;
+    for (const char *p = begin; p < end && *p >= '0' && *p <= '9'; ++p)
+    {
+        id = id * 10 + static_cast<uint64_t>(*p - '0');
+    }
+    return id;
+}
+
+/** \brief  Converts the span into a double. Attribute values
+ *          are always followed by their closing quote, which
+ *          stops strtod at the end of the span.
+ *
+ *          @return double
+*/
+double OsmScanner::Span::toDouble() const
+{
+    return std::strtod(begin, nullptr);
+}
+
+/** \brief  Constructor that takes the character range to
+ *          scan, typically a memory-mapped .osm file.
+*/
+OsmScanner::OsmScanner(const char *begin, const char *end)
+        :cur(begin), last(end), selfClosing(false)
+{
+    attributes.reserve(16);
+}
+
+/** \brief  Moves forward to the next element in the buffer,
+ *          skipping text, comments and processing instructions,
+ *          and reads its attributes. Only the elements needed
+ *          to build the map, or to apply an osmChange file to
+ *          it, are told apart, everything else is reported as
+ *          OTHER.
+ *
+ *          @return OsmScanner::Element
+*/
+OsmScanner::Element OsmScanner::next()
+{
+    while (cur < last)
+    {
+        const char *lt = static_cast<const char *>(std::memchr(cur, '<', last - cur));
+        if (lt == nullptr || lt + 1 >= last)
+        {
+            break;
+        }
+        const char *p = lt + 1;
+        if (*p == '?' || *p == '!')
+        {
+            //Declarations, comments and CDATA carry nothing we need
+            const char *stop = (last - p >= 3 && std::memcmp(p, "!--", 3) == 0) ?
+                findSeq(p, last, "-->") : static_cast<const char *>(std::memchr(p, '>', last - p));
+            cur = (stop == nullptr || stop == last) ? last : stop + 1;
+            continue;
+        }
+        bool closing = (*p == '/');
+        if (closing)
+        {
+            ++p;
+        }
+        const char *nameBegin = p;
+        while (p < last && !isSpace(*p) && *p != '>' && *p != '/')
+        {
+            ++p;
+        }
+        const char *nameEnd = p;
+        cur = p;
+        attributes.clear();
+        if (closing)
+        {
+            const char *gt = static_cast<const char *>(std::memchr(cur, '>', last - cur));
+            cur = (gt == nullptr) ? last : gt + 1;
+            selfClosing = false;
+            if (nameIs(nameBegin, nameEnd, "node")) return NODE_END;
+            if (nameIs(nameBegin, nameEnd, "way")) return WAY_END;
+            if (nameIs(nameBegin, nameEnd, "create") || nameIs(nameBegin, nameEnd, "modify") ||
+                nameIs(nameBegin, nameEnd, "delete")) return SECTION_END;
+            return OTHER;
+        }
+        readAttributes();
+        if (nameIs(nameBegin, nameEnd, "nd")) return ND;
+        if (nameIs(nameBegin, nameEnd, "tag")) return TAG;
+        if (nameIs(nameBegin, nameEnd, "node")) return NODE;
+        if (nameIs(nameBegin, nameEnd, "way")) return WAY;
+        if (nameIs(nameBegin, nameEnd, "create")) return CREATE;
+        if (nameIs(nameBegin, nameEnd, "modify")) return MODIFY;
+        if (nameIs(nameBegin, nameEnd, "delete")) return DELETE;
+        return OTHER;
+    }
+    cur = last;
+    return DONE;
+}
+
+/** \brief  Reads name="value" pairs starting at cur up to the
+ *          closing '>' of the element. Values are located with
+ *          memchr on their quote character, so a '>' inside a
+ *          value does not end the element.
+ *
+ *          @return void
+*/
+void OsmScanner::readAttributes()
+{
+    selfClosing = false;
+    while (cur < last)
+    {
+        char c = *cur;
+        if (isSpace(c))
+        {
+            ++cur;
+        }
+        else if (c == '/')
+        {
+            selfClosing = true;
+            ++cur;
+        }
+        else if (c == '>')
+        {
+            ++cur;
+            return;
+        }
+        else
+        {
+            Attribute attr;
+            attr.name.begin = cur;
+            while (cur < last && *cur != '=' && !isSpace(*cur) && *cur != '>')
+            {
+                ++cur;
+            }
+            attr.name.end = cur;
+            while (cur < last && (isSpace(*cur) || *cur == '='))
+            {
+                ++cur;
+            }
+            if (cur >= last || (*cur != '"' && *cur != '\''))
+            {
+                continue;
+            }
+            char quote = *cur++;
+            const char *close = static_cast<const char *>(std::memchr(cur, quote, last - cur));
+            if (close == nullptr)
+            {
+                cur = last;
+                return;
+            }
+            attr.value.begin = cur;
+            attr.value.end = close;
+            attributes.push_back(attr);
+            cur = close + 1;
+        }
+    }
+}
+
+/** \brief  Returns true if the current element closes itself.
+ *
+ *          @return bool
+*/
+bool OsmScanner::isSelfClosing() const
+{
+    return selfClosing;
+}
+
+/** \brief  Finds the attribute with the given name on the
+ *          current element and stores its value in value.
+ *
+ *          @return bool true if the attribute exists
+*/
+bool OsmScanner::getAttribute(const char *name, Span &value) const
+{
+    for (const Attribute &attr : attributes)
+    {
+        if (attr.name.equals(name))
+        {
+            value = attr.value;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** \brief  Returns the position just past the current element.
+ *
+ *          @return const char *
+*/
+const char *OsmScanner::position() const
+{
+    return cur;
+}
@@ -0,0 +1,49 @@
+/**
+ * @brief OsmScanner Class header
+ */
+#ifndef OSMSCANNER_H
+#define OSMSCANNER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class OsmScanner {
+    public:
+        // Kinds of element the scanner reports. CREATE, MODIFY and DELETE
+        // open the sections of an osmChange file and SECTION_END closes them.
+        enum Element { NODE, NODE_END, WAY, WAY_END, ND, TAG, CREATE, MODIFY, DELETE, SECTION_END, OTHER, DONE };
+        // A [begin, end) range of characters inside the scanned buffer
+        struct Span {
+            const char *begin;
+            const char *end;
+            bool equals(const char *) const;
+            uint64_t toId() const;
+            double toDouble() const;
+        };
+
+    private:
+        struct Attribute {
+            Span name;
+            Span value;
+        };
+        const char *cur, *last;
+        bool selfClosing;
+        std::vector<Attribute> attributes;
+
+        //Reads the attributes of the element at cur into attributes
+        void readAttributes();
+
+    public:
+        OsmScanner(const char *begin, const char *end);
+        // Advances to the next element and returns its kind
+        Element next();
+        // True if the current element is written as <name .../>
+        bool isSelfClosing() const;
+        // Looks up an attribute of the current element by name
+        bool getAttribute(const char *name, Span &value) const;
+        // Position just past the current element
+        const char *position() const;
+};
+
+#endif
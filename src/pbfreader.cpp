@@ -0,0 +1,528 @@
+/**
+ * @brief PbfReader Class implementation
+ */
+
+#include "pbfreader.hpp"
+#include "inflater.hpp"
+#include <cstring>
+#include <string>
+
+namespace {
+    // Largest BlobHeader and uncompressed Blob the format allows
+    const uint32_t MAX_HEADER_SIZE = 64 * 1024;
+    const uint32_t MAX_BLOB_SIZE = 32 * 1024 * 1024;
+    // Protocol buffer wire types
+    enum WireType { VARINT = 0, FIXED64 = 1, LENGTH_DELIMITED = 2, FIXED32 = 5 };
+
+    // A run of bytes inside a decoded message
+    struct Bytes {
+        const uint8_t *begin;
+        const uint8_t *end;
+        bool equals(const char *text) const
+        {
+            size_t length = std::strlen(text);
+            return static_cast<size_t>(end - begin) == length && std::memcmp(begin, text, length) == 0;
+        }
+    };
+
+    // Reads the fields of one protocol buffer message in order. Reads
+    // past the end set bad and return zeros, so callers check bad once.
+    struct Message {
+        const uint8_t *p, *end;
+        bool bad;
+
+        Message(const uint8_t *first, const uint8_t *last) : p(first), end(last), bad(false) {}
+        explicit Message(const Bytes &bytes) : p(bytes.begin), end(bytes.end), bad(false) {}
+
+        bool more() const { return p < end && !bad; }
+
+        uint64_t varint()
+        {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64; shift += 7)
+            {
+                if (p == end)
+                {
+                    break;
+                }
+                uint8_t byte = *p++;
+                value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    return value;
+                }
+            }
+            bad = true;
+            return 0;
+        }
+
+        int64_t svarint()
+        {
+            uint64_t value = varint();
+            return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+
+        //Reads the next field key, false at the end of the message
+        bool next(uint32_t &field, uint32_t &wire)
+        {
+            if (!more())
+            {
+                return false;
+            }
+            uint64_t key = varint();
+            field = static_cast<uint32_t>(key >> 3);
+            wire = static_cast<uint32_t>(key & 7);
+            return !bad;
+        }
+
+        Bytes bytes()
+        {
+            uint64_t length = varint();
+            Bytes result = { p, p };
+            if (bad || length > static_cast<uint64_t>(end - p))
+            {
+                bad = true;
+                return result;
+            }
+            result.end = p + length;
+            p += length;
+            return result;
+        }
+
+        void skip(uint32_t wire)
+        {
+            size_t length = 0;
+            switch (wire)
+            {
+                case VARINT: varint(); return;
+                case LENGTH_DELIMITED: bytes(); return;
+                case FIXED64: length = 8; break;
+                case FIXED32: length = 4; break;
+                default: bad = true; return;
+            }
+            if (static_cast<size_t>(end - p) < length)
+            {
+                bad = true;
+                return;
+            }
+            p += length;
+        }
+    };
+
+    // One blob of the file: its type, and the data that follows the header
+    struct Frame {
+        Bytes type;
+        Bytes blob;
+        const uint8_t *next;
+    };
+
+    /** \brief  Reads the length prefix and BlobHeader at p and
+     *          locates the blob after it.
+     *
+     *          @return bool false if the framing is broken
+    */
+    bool readFrame(const uint8_t *p, const uint8_t *end, Frame &frame)
+    {
+        if (end - p < 4)
+        {
+            return false;
+        }
+        uint32_t headerSize = (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        p += 4;
+        if (headerSize > MAX_HEADER_SIZE || headerSize > static_cast<size_t>(end - p))
+        {
+            return false;
+        }
+        Message header(p, p + headerSize);
+        uint64_t dataSize = 0;
+        bool hasType = false, hasSize = false;
+        uint32_t field, wire;
+        while (header.next(field, wire))
+        {
+            if (field == 1 && wire == LENGTH_DELIMITED)
+            {
+                frame.type = header.bytes();
+                hasType = true;
+            }
+            else if (field == 3 && wire == VARINT)
+            {
+                dataSize = header.varint();
+                hasSize = true;
+            }
+            else
+            {
+                header.skip(wire);
+            }
+        }
+        p += headerSize;
+        if (header.bad || !hasType || !hasSize || dataSize > MAX_BLOB_SIZE ||
+            dataSize > static_cast<uint64_t>(end - p))
+        {
+            return false;
+        }
+        frame.blob.begin = p;
+        frame.blob.end = p + dataSize;
+        frame.next = frame.blob.end;
+        return true;
+    }
+
+    /** \brief  Unpacks a Blob message, inflating zlib data into
+     *          buffer. Raw blobs are used where they lie.
+     *
+     *          @return bool false on other compressions or bad data
+    */
+    bool unpackBlob(const Bytes &blob, std::vector<char> &buffer, Bytes &data)
+    {
+        Message message(blob);
+        Bytes raw = { nullptr, nullptr }, zlib = { nullptr, nullptr };
+        uint64_t rawSize = 0;
+        bool hasRaw = false, hasZlib = false;
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (field == 1 && wire == LENGTH_DELIMITED)
+            {
+                raw = message.bytes();
+                hasRaw = true;
+            }
+            else if (field == 2 && wire == VARINT)
+            {
+                rawSize = message.varint();
+            }
+            else if (field == 3 && wire == LENGTH_DELIMITED)
+            {
+                zlib = message.bytes();
+                hasZlib = true;
+            }
+            else if (field >= 4 && field <= 7)
+            {
+                //lzma, bzip2, lz4 and zstd blobs are not supported
+                return false;
+            }
+            else
+            {
+                message.skip(wire);
+            }
+        }
+        if (message.bad)
+        {
+            return false;
+        }
+        if (hasRaw)
+        {
+            data = raw;
+            return true;
+        }
+        if (!hasZlib || rawSize > MAX_BLOB_SIZE)
+        {
+            return false;
+        }
+        buffer.resize(rawSize);
+        if (!Inflater::inflate(reinterpret_cast<const char *>(zlib.begin), zlib.end - zlib.begin,
+                               buffer.data(), buffer.size()))
+        {
+            return false;
+        }
+        data.begin = reinterpret_cast<const uint8_t *>(buffer.data());
+        data.end = data.begin + buffer.size();
+        return true;
+    }
+
+    /** \brief  Checks that every required feature of a
+     *          HeaderBlock is one this reader handles.
+     *
+     *          @return bool
+    */
+    bool supportedHeader(const Bytes &block)
+    {
+        Message message(block);
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (field == 4 && wire == LENGTH_DELIMITED)
+            {
+                Bytes feature = message.bytes();
+                if (!feature.equals("OsmSchema-V0.6") && !feature.equals("DenseNodes"))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                message.skip(wire);
+            }
+        }
+        return !message.bad;
+    }
+
+    // Coordinate encoding and string table of one PrimitiveBlock
+    struct BlockContext {
+        int64_t granularity, latOffset, lonOffset;
+        std::vector<Bytes> strings;
+
+        double lat(int64_t value) const { return double(latOffset + granularity * value) / 1e9; }
+        double lon(int64_t value) const { return double(lonOffset + granularity * value) / 1e9; }
+    };
+
+    /** \brief  Decodes a DenseNodes message, whose ids and
+     *          coordinates are delta coded packed arrays.
+     *
+     *          @return bool
+    */
+    bool readDenseNodes(const Bytes &dense, const BlockContext &context, ChunkScan &chunk)
+    {
+        Message message(dense);
+        Bytes ids = { nullptr, nullptr }, lats = ids, lons = ids;
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (wire == LENGTH_DELIMITED && field == 1) ids = message.bytes();
+            else if (wire == LENGTH_DELIMITED && field == 8) lats = message.bytes();
+            else if (wire == LENGTH_DELIMITED && field == 9) lons = message.bytes();
+            else message.skip(wire);
+        }
+        Message id(ids), lat(lats), lon(lons);
+        int64_t nodeId = 0, nodeLat = 0, nodeLon = 0;
+        while (id.more())
+        {
+            nodeId += id.svarint();
+            nodeLat += lat.svarint();
+            nodeLon += lon.svarint();
+            if (id.bad || lat.bad || lon.bad)
+            {
+                return false;
+            }
+            chunk.addNode(static_cast<uint64_t>(nodeId), context.lat(nodeLat), context.lon(nodeLon));
+        }
+        return !message.bad && !id.bad;
+    }
+
+    /** \brief  Decodes a plain Node message.
+     *
+     *          @return bool
+    */
+    bool readNode(const Bytes &node, const BlockContext &context, ChunkScan &chunk)
+    {
+        Message message(node);
+        int64_t nodeId = 0, nodeLat = 0, nodeLon = 0;
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (wire == VARINT && field == 1) nodeId = message.svarint();
+            else if (wire == VARINT && field == 8) nodeLat = message.svarint();
+            else if (wire == VARINT && field == 9) nodeLon = message.svarint();
+            else message.skip(wire);
+        }
+        if (message.bad)
+        {
+            return false;
+        }
+        chunk.addNode(static_cast<uint64_t>(nodeId), context.lat(nodeLat), context.lon(nodeLon));
+        return true;
+    }
+
+    /** \brief  Decodes a Way message, passing it to the chunk
+     *          if it is tagged as a highway. Tags are indices
+     *          into the string table, and refs are delta coded.
+     *
+     *          @return bool
+    */
+    bool readWay(const Bytes &way, const BlockContext &context, ChunkScan &chunk, std::vector<uint64_t> &refs)
+    {
+        Message message(way);
+        Bytes packedRefs = { nullptr, nullptr }, packedKeys = packedRefs, packedValues = packedRefs;
+        uint64_t wayId = 0;
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (field == 1 && wire == VARINT) wayId = message.varint();
+            else if (field == 2 && wire == LENGTH_DELIMITED) packedKeys = message.bytes();
+            else if (field == 3 && wire == LENGTH_DELIMITED) packedValues = message.bytes();
+            else if (field == 8 && wire == LENGTH_DELIMITED) packedRefs = message.bytes();
+            else message.skip(wire);
+        }
+        WayTags tags;
+        Message keys(packedKeys), values(packedValues);
+        while (keys.more())
+        {
+            uint64_t key = keys.varint(), value = values.varint();
+            if (keys.bad || values.bad || key >= context.strings.size() || value >= context.strings.size())
+            {
+                return false;
+            }
+            const Bytes &k = context.strings[key], &v = context.strings[value];
+            tags.add(reinterpret_cast<const char *>(k.begin), k.end - k.begin,
+                     reinterpret_cast<const char *>(v.begin), v.end - v.begin);
+        }
+        if (message.bad || keys.bad)
+        {
+            return false;
+        }
+        if (!tags.isHighway())
+        {
+            return true;
+        }
+        refs.clear();
+        Message ref(packedRefs);
+        int64_t nodeId = 0;
+        while (ref.more())
+        {
+            nodeId += ref.svarint();
+            refs.push_back(static_cast<uint64_t>(nodeId));
+        }
+        if (ref.bad)
+        {
+            return false;
+        }
+        chunk.addHighway(wayId, refs, tags.finish());
+        return true;
+    }
+
+    /** \brief  Decodes a PrimitiveBlock. Its string table and
+     *          coordinate encoding may follow the groups, so
+     *          they are read first and the groups after.
+     *
+     *          @return bool
+    */
+    bool readPrimitiveBlock(const Bytes &block, ChunkScan &chunk, std::vector<uint64_t> &refs)
+    {
+        BlockContext context = { 100, 0, 0, std::vector<Bytes>() };
+        std::vector<Bytes> groups;
+        Bytes strings = { nullptr, nullptr };
+        Message message(block);
+        uint32_t field, wire;
+        while (message.next(field, wire))
+        {
+            if (field == 1 && wire == LENGTH_DELIMITED) strings = message.bytes();
+            else if (field == 2 && wire == LENGTH_DELIMITED) groups.push_back(message.bytes());
+            else if (field == 17 && wire == VARINT) context.granularity = static_cast<int64_t>(message.varint());
+            else if (field == 19 && wire == VARINT) context.latOffset = static_cast<int64_t>(message.varint());
+            else if (field == 20 && wire == VARINT) context.lonOffset = static_cast<int64_t>(message.varint());
+            else message.skip(wire);
+        }
+        Message table(strings);
+        while (table.next(field, wire))
+        {
+            if (field == 1 && wire == LENGTH_DELIMITED)
+            {
+                context.strings.push_back(table.bytes());
+            }
+            else
+            {
+                table.skip(wire);
+            }
+        }
+        if (message.bad || table.bad)
+        {
+            return false;
+        }
+        bool readNodes = (chunk.kind != ChunkScan::WAYS), readWays = (chunk.kind != ChunkScan::NODES);
+        for (const Bytes &group : groups)
+        {
+            Message entities(group);
+            bool ok = true;
+            while (ok && entities.next(field, wire))
+            {
+                if (wire != LENGTH_DELIMITED)
+                {
+                    entities.skip(wire);
+                    continue;
+                }
+                Bytes entity = entities.bytes();
+                if (field == 1 && readNodes) ok = readNode(entity, context, chunk);
+                else if (field == 2 && readNodes) ok = readDenseNodes(entity, context, chunk);
+                else if (field == 3 && readWays) ok = readWay(entity, context, chunk, refs);
+            }
+            if (!ok || entities.bad)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+/** \brief  Returns true if the buffer starts with a blob
+ *          header of type OSMHeader, which every PBF file
+ *          begins with.
+ *
+ *          @return bool
+*/
+bool PbfReader::isPbf(const char *begin, const char *end)
+{
+    //4 byte length, then field 1 of the BlobHeader: tag 0x0a, length 9, "OSMHeader"
+    const char PREFIX[] = "\x0a\x09OSMHeader";
+    const size_t PREFIX_SIZE = sizeof(PREFIX) - 1;
+    return static_cast<size_t>(end - begin) >= 4 + PREFIX_SIZE && std::memcmp(begin + 4, PREFIX, PREFIX_SIZE) == 0;
+}
+
+/** \brief  Walks the blob headers, which is cheap because no
+ *          blob is decompressed except the OSMHeader, and
+ *          groups whole blobs into chunks. The OSMHeader's
+ *          required features must all be supported.
+ *
+ *          @return bool
+*/
+bool PbfReader::split(const char *begin, const char *end, std::vector<const char *> &starts)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(begin);
+    const uint8_t *last = reinterpret_cast<const uint8_t *>(end);
+    const uint8_t *chunkStart = p;
+    std::vector<char> buffer;
+    starts.assign(1, begin);
+    while (p < last)
+    {
+        Frame frame;
+        if (!readFrame(p, last, frame))
+        {
+            return false;
+        }
+        if (frame.type.equals("OSMHeader"))
+        {
+            Bytes block;
+            if (!unpackBlob(frame.blob, buffer, block) || !supportedHeader(block))
+            {
+                return false;
+            }
+        }
+        p = frame.next;
+        if (p < last && static_cast<size_t>(p - chunkStart) >= ChunkScan::CHUNK_BYTES)
+        {
+            starts.push_back(reinterpret_cast<const char *>(p));
+            chunkStart = p;
+        }
+    }
+    return true;
+}
+
+/** \brief  Decodes every OSMData blob in [begin, end), which
+ *          must start at a blob boundary, into the chunk.
+ *          Other blob types are skipped.
+ *
+ *          @return bool
+*/
+bool PbfReader::scan(const char *begin, const char *end, ChunkScan &chunk)
+{
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(begin);
+    const uint8_t *last = reinterpret_cast<const uint8_t *>(end);
+    std::vector<char> buffer;
+    std::vector<uint64_t> refs;
+    while (p < last)
+    {
+        Frame frame;
+        if (!readFrame(p, last, frame))
+        {
+            return false;
+        }
+        if (frame.type.equals("OSMData"))
+        {
+            Bytes block;
+            if (!unpackBlob(frame.blob, buffer, block) || !readPrimitiveBlock(block, chunk, refs))
+            {
+                return false;
+            }
+        }
+        p = frame.next;
+    }
+    return true;
+}
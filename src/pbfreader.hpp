@@ -0,0 +1,23 @@
+/**
+ * @brief PbfReader Class header
+ */
+#ifndef PBFREADER_H
+#define PBFREADER_H
+
+#include <vector>
+#include "chunkscan.hpp"
+
+// Reader for OpenStreetMap PBF files. A file is a sequence of blobs,
+// each holding a zlib compressed or raw block of nodes and ways.
+class PbfReader {
+    public:
+        // True if the buffer starts with the OSMHeader blob of a PBF file
+        static bool isPbf(const char *begin, const char *end);
+        // Start of every chunk of whole blobs of about ChunkScan::CHUNK_BYTES.
+        // False if the framing is broken or the file needs features this reader lacks.
+        static bool split(const char *begin, const char *end, std::vector<const char *> &starts);
+        // Decodes the data blobs in [begin, end) into chunk, false on malformed data
+        static bool scan(const char *begin, const char *end, ChunkScan &chunk);
+};
+
+#endif
@@ -0,0 +1,283 @@
+/**
+ * @brief Profile Class implementation
+ */
+
+#include "profile.hpp"
+#include <cstring>
+#include <limits>
+
+namespace {
+    // Speeds in km/h for each Profile::Highway class, 0 where the class may not be used
+    const uint8_t CAR_SPEEDS[Profile::HIGHWAY_CLASSES] = {
+        110, 60, 90, 50, 70, 45, 60, 40, 50, 35, 40, 30, 10, 15, 0, 0, 0, 0, 0, 0, 0 };
+    const uint8_t BIKE_SPEEDS[Profile::HIGHWAY_CLASSES] = {
+        0, 0, 0, 0, 16, 16, 18, 18, 18, 18, 18, 18, 10, 14, 12, 12, 20, 6, 6, 2, 0 };
+    const uint8_t FOOT_SPEEDS[Profile::HIGHWAY_CLASSES] = {
+        0, 0, 0, 0, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 3, 0 };
+    // Tagged speed limits above this are not believed
+    const float MAXSPEED_CAP = 130;
+    const float KMH = 1 / 3.6f;
+
+    // Values of the highway tag, in Profile::Highway order
+    const char *const HIGHWAY_VALUES[Profile::OTHER] = {
+        "motorway", "motorway_link", "trunk", "trunk_link", "primary", "primary_link",
+        "secondary", "secondary_link", "tertiary", "tertiary_link", "unclassified",
+        "residential", "living_street", "service", "track", "path", "cycleway", "footway",
+        "pedestrian", "steps" };
+
+    bool equals(const char *text, size_t length, const char *lit)
+    {
+        return std::strlen(lit) == length && std::memcmp(text, lit, length) == 0;
+    }
+
+    /** \brief  Maps a highway tag value to its class. Values
+     *          that route like one of the classes are folded
+     *          into it, and the rest are OTHER.
+     *
+     *          @return Profile::Highway
+    */
+    Profile::Highway classify(const char *value, size_t length)
+    {
+        for (int i = 0; i < Profile::OTHER; i++)
+        {
+            if (equals(value, length, HIGHWAY_VALUES[i]))
+            {
+                return static_cast<Profile::Highway>(i);
+            }
+        }
+        if (equals(value, length, "road"))
+        {
+            return Profile::UNCLASSIFIED;
+        }
+        if (equals(value, length, "bridleway"))
+        {
+            return Profile::PATH;
+        }
+        if (equals(value, length, "corridor"))
+        {
+            return Profile::FOOTWAY;
+        }
+        return Profile::OTHER;
+    }
+
+    /** \brief  Reads a maxspeed tag such as "50" or "30 mph"
+     *          into km/h. Values without a leading number, like
+     *          "none" or "signals", give 0.
+     *
+     *          @return uint8_t
+    */
+    uint8_t parseMaxspeed(const char *value, size_t length)
+    {
+        unsigned speed = 0;
+        size_t i = 0;
+        for (; i < length && value[i] >= '0' && value[i] <= '9' && speed < 1000; i++)
+        {
+            speed = speed * 10 + static_cast<unsigned>(value[i] - '0');
+        }
+        while (i < length && value[i] == ' ')
+        {
+            i++;
+        }
+        if (length - i == 3 && std::memcmp(value + i, "mph", 3) == 0)
+        {
+            speed = speed * 1609 / 1000;
+        }
+        return static_cast<uint8_t>(speed > 255 ? 255 : speed);
+    }
+}
+
+/** \brief  Constructor that sets up the speed table and
+ *          rules of the given mode of travel.
+*/
+Profile::Profile(Type profileType)
+        :type(profileType), followsOneway(profileType == CAR || profileType == BIKE),
+         usesMaxspeed(profileType == CAR)
+{
+    const uint8_t *table = (type == CAR) ? CAR_SPEEDS : (type == BIKE) ? BIKE_SPEEDS : FOOT_SPEEDS;
+    for (int i = 0; i < HIGHWAY_CLASSES; i++)
+    {
+        speeds[i] = table[i] * KMH;
+    }
+}
+
+/** \brief  Returns the mode of travel of this profile.
+ *
+ *          @return Profile::Type
+*/
+Profile::Type Profile::getType() const
+{
+    return type;
+}
+
+/** \brief  Returns the cost of an arc: its length for
+ *          DISTANCE, and the seconds it takes otherwise. A car
+ *          drives at the tagged speed limit where there is one,
+ *          capped at MAXSPEED_CAP, and at its class speed
+ *          elsewhere. Cars and bikes may not go against a
+ *          oneway.
+ *
+ *          @return float infinity if the arc may not be used
+*/
+float Profile::weight(const EdgeAttributes &attributes, float length, bool reversed) const
+{
+    if (type == DISTANCE)
+    {
+        return length;
+    }
+    const float NO_ACCESS = std::numeric_limits<float>::infinity();
+    uint8_t oneway = attributes.oneway;
+    if (reversed && oneway != BOTH_WAYS)
+    {
+        oneway = (oneway == ALONG) ? AGAINST : ALONG;
+    }
+    float speed = (attributes.highway < HIGHWAY_CLASSES) ? speeds[attributes.highway] : 0;
+    if (speed == 0 || (followsOneway && oneway == AGAINST))
+    {
+        return NO_ACCESS;
+    }
+    if (usesMaxspeed && attributes.maxspeed != 0)
+    {
+        speed = (attributes.maxspeed < MAXSPEED_CAP ? attributes.maxspeed : MAXSPEED_CAP) * KMH;
+    }
+    return length / speed;
+}
+
+/** \brief  Returns the cost of a metre at the fastest speed
+ *          the profile ever travels at.
+ *
+ *          @return double
+*/
+double Profile::minCostPerMetre() const
+{
+    if (type == DISTANCE)
+    {
+        return 1;
+    }
+    float fastest = usesMaxspeed ? MAXSPEED_CAP * KMH : 0;
+    for (int i = 0; i < HIGHWAY_CLASSES; i++)
+    {
+        if (speeds[i] > fastest)
+        {
+            fastest = speeds[i];
+        }
+    }
+    return 1 / static_cast<double>(fastest);
+}
+
+/** \brief  Returns the name of a profile, as parse() reads it.
+ *
+ *          @return const char *
+*/
+const char *Profile::name(Type profileType)
+{
+    switch (profileType)
+    {
+        case DISTANCE: return "distance";
+        case CAR: return "car";
+        case BIKE: return "bike";
+        case FOOT: return "foot";
+    }
+    return "";
+}
+
+/** \brief  Reads a profile name.
+ *
+ *          @return bool false if text names no profile
+*/
+bool Profile::parse(const char *text, Type &profileType)
+{
+    const Type TYPES[] = { DISTANCE, CAR, BIKE, FOOT };
+    for (Type t : TYPES)
+    {
+        if (std::strcmp(text, name(t)) == 0)
+        {
+            profileType = t;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** \brief  Constructor for the tags of a way with no tags.
+*/
+WayTags::WayTags()
+{
+    clear();
+}
+
+/** \brief  Forgets the tags of the previous way.
+ *
+ *          @return void
+*/
+void WayTags::clear()
+{
+    highway = roundabout = onewayTagged = false;
+    attributes.highway = Profile::OTHER;
+    attributes.oneway = Profile::BOTH_WAYS;
+    attributes.maxspeed = 0;
+    attributes.reserved = 0;
+}
+
+/** \brief  Reads one tag. Only highway, oneway, maxspeed and
+ *          junction matter, other keys are ignored.
+ *
+ *          @return void
+*/
+void WayTags::add(const char *key, size_t keyLength, const char *value, size_t valueLength)
+{
+    if (equals(key, keyLength, "highway"))
+    {
+        highway = true;
+        attributes.highway = static_cast<uint8_t>(classify(value, valueLength));
+    }
+    else if (equals(key, keyLength, "oneway"))
+    {
+        onewayTagged = true;
+        if (equals(value, valueLength, "yes") || equals(value, valueLength, "true") ||
+            equals(value, valueLength, "1"))
+        {
+            attributes.oneway = Profile::ALONG;
+        }
+        else if (equals(value, valueLength, "-1") || equals(value, valueLength, "reverse"))
+        {
+            attributes.oneway = Profile::AGAINST;
+        }
+        else
+        {
+            attributes.oneway = Profile::BOTH_WAYS;
+        }
+    }
+    else if (equals(key, keyLength, "maxspeed"))
+    {
+        attributes.maxspeed = parseMaxspeed(value, valueLength);
+    }
+    else if (equals(key, keyLength, "junction"))
+    {
+        roundabout = equals(value, valueLength, "roundabout") || equals(value, valueLength, "circular");
+    }
+}
+
+/** \brief  Returns true once a highway tag has been read.
+ *
+ *          @return bool
+*/
+bool WayTags::isHighway() const
+{
+    return highway;
+}
+
+/** \brief  Returns the attributes read so far. Motorways and
+ *          roundabouts are oneway unless tagged otherwise.
+ *
+ *          @return EdgeAttributes
+*/
+EdgeAttributes WayTags::finish() const
+{
+    EdgeAttributes result = attributes;
+    if (!onewayTagged && (roundabout || result.highway == Profile::MOTORWAY ||
+                          result.highway == Profile::MOTORWAY_LINK))
+    {
+        result.oneway = Profile::ALONG;
+    }
+    return result;
+}
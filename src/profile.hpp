@@ -0,0 +1,73 @@
+/**
+ * @brief Profile Class header
+ */
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Attributes of the highway way an edge comes from, stored once per arc
+struct EdgeAttributes {
+    uint8_t highway;    /** Profile::Highway class of the way. */
+    uint8_t oneway;     /** Profile::Oneway, relative to the direction of the edge or arc. */
+    uint8_t maxspeed;   /** Tagged speed limit in km/h, 0 if none. */
+    uint8_t reserved;
+};
+
+// Turns edge attributes into arc weights and access rules for one
+// mode of travel. Weights are computed once per arc when a profile
+// is applied to a graph, so searches only read them.
+class Profile {
+    public:
+        // Modes of travel. DISTANCE weighs every arc by its length and
+        // allows every arc, which is how the graph was routed before
+        // edges had attributes.
+        enum Type { DISTANCE, CAR, BIKE, FOOT };
+        // Highway classes, from the value of a way's highway tag
+        enum Highway { MOTORWAY, MOTORWAY_LINK, TRUNK, TRUNK_LINK, PRIMARY, PRIMARY_LINK,
+                       SECONDARY, SECONDARY_LINK, TERTIARY, TERTIARY_LINK, UNCLASSIFIED,
+                       RESIDENTIAL, LIVING_STREET, SERVICE, TRACK, PATH, CYCLEWAY, FOOTWAY,
+                       PEDESTRIAN, STEPS, OTHER, HIGHWAY_CLASSES };
+        // Which ways along an edge may be travelled by vehicles
+        enum Oneway { BOTH_WAYS, ALONG, AGAINST };
+
+    private:
+        Type type;
+        // Speed on each class in metres per second, 0 if it may not be used
+        float speeds[HIGHWAY_CLASSES];
+        bool followsOneway;
+        bool usesMaxspeed;
+
+    public:
+        explicit Profile(Type profileType = DISTANCE);
+        Type getType() const;
+        // Cost of going along an arc, or across it backwards when reversed
+        // is set. Infinity if the profile may not go that way.
+        float weight(const EdgeAttributes &attributes, float length, bool reversed) const;
+        // Lower bound on the cost of a metre, which keeps A* admissible
+        double minCostPerMetre() const;
+        static const char *name(Type profileType);
+        // Parses "car", "bike", "foot" or "distance", false for anything else
+        static bool parse(const char *text, Type &profileType);
+};
+
+// Collects the tags of one way, in any order, into its EdgeAttributes
+class WayTags {
+    private:
+        bool highway;
+        bool roundabout;
+        bool onewayTagged;
+        EdgeAttributes attributes;
+
+    public:
+        WayTags();
+        void clear();
+        void add(const char *key, size_t keyLength, const char *value, size_t valueLength);
+        // True once a highway tag has been seen
+        bool isHighway() const;
+        // Attributes of the way, with implied oneways applied
+        EdgeAttributes finish() const;
+};
+
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @brief Projection Class implementation
+ */
+
+#include "projection.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const double PI = 3.14159265358979323846;
+    const double TO_RAD = PI / 180.0;
+    // Web Mercator is cut off at the latitudes that make the world square
+    const double MAX_MERCATOR_LAT = 85.0511287798;
+    // Added before truncating so that truncation rounds down for any
+    // pixel above -BIAS, which keeps the rounding loop free of branches
+    const double BIAS = 1 << 30;
+}
+
+/** \brief  Constructor for the identity projection of a
+ *          canvas with no map bounds.
+*/
+Projection::Projection()
+        :type(EQUIRECTANGULAR), originX(0), originY(0), scale(1), offsetRow(0), offsetColumn(0), lonScale(1)
+{
+}
+
+/** \brief  Constructor that fits the box onto a canvas of
+ *          rows by columns. The scale is the largest one at
+ *          which the whole box fits on both axes, and the
+ *          leftover space on the other axis is split evenly on
+ *          both sides.
+*/
+Projection::Projection(Type projectionType, double minLat, double minLon, double maxLat, double maxLon,
+                       unsigned rows, unsigned columns)
+        :type(projectionType), lonScale(std::cos((minLat + maxLat) / 2 * TO_RAD))
+{
+    originX = projectX(minLon);
+    originY = projectY(maxLat);
+    double width = projectX(maxLon) - originX;
+    double height = projectY(minLat) - originY;
+    double usableRows = rows > 0 ? rows - 1 : 0;
+    double usableColumns = columns > 0 ? columns - 1 : 0;
+    if (width > 0 && height > 0)
+    {
+        scale = std::min(usableColumns / width, usableRows / height);
+    }
+    else if (width > 0 || height > 0)
+    {
+        scale = (width > 0) ? usableColumns / width : usableRows / height;
+    }
+    else
+    {
+        scale = 1;
+    }
+    offsetRow = (usableRows - height * scale) / 2;
+    offsetColumn = (usableColumns - width * scale) / 2;
+}
+
+/** \brief  Returns the type of projection.
+ *
+ *          @return Projection::Type
+*/
+Projection::Type Projection::getType() const
+{
+    return type;
+}
+
+/** \brief  Projected east-west position of a longitude, in
+ *          degrees at the equator.
+ *
+ *          @return double
+*/
+double Projection::projectX(double lon) const
+{
+    return (type == EQUIRECTANGULAR) ? lon * lonScale : lon;
+}
+
+/** \brief  Projected north-south position of a latitude, in
+ *          the same unit as projectX and growing southwards.
+ *
+ *          @return double
+*/
+double Projection::projectY(double lat) const
+{
+    if (type == EQUIRECTANGULAR)
+    {
+        return -lat;
+    }
+    lat = std::max(-MAX_MERCATOR_LAT, std::min(MAX_MERCATOR_LAT, lat)) * TO_RAD;
+    return -std::log(std::tan(lat) + 1 / std::cos(lat)) / TO_RAD;
+}
+
+/** \brief  Returns the row a latitude falls on.
+ *
+ *          @return double
+*/
+double Projection::row(double lat) const
+{
+    return (projectY(lat) - originY) * scale + offsetRow;
+}
+
+/** \brief  Returns the column a longitude falls on.
+ *
+ *          @return double
+*/
+double Projection::column(double lon) const
+{
+    return (projectX(lon) - originX) * scale + offsetColumn;
+}
+
+/** \brief  Projects every node of the graph in one pass over
+ *          its coordinate arrays. Columns, and rows under
+ *          EQUIRECTANGULAR, are a multiply and an add per node
+ *          with no branches, which an optimizing compiler turns into
+ *          vector instructions. Web Mercator rows need a
+ *          logarithm per node and are computed one by one.
+ *
+ *          @return void
+*/
+void Projection::project(const Graph &g, std::vector<int32_t> &rows, std::vector<int32_t> &columns) const
+{
+    size_t n = g.size();
+    rows.resize(n);
+    columns.resize(n);
+    const double *lats = g.latitudes();
+    const double *lons = g.longitudes();
+    int32_t *rowOut = rows.data();
+    int32_t *columnOut = columns.data();
+    //column = lon * columnA + columnB, and the same for equirectangular rows
+    double columnA = (type == EQUIRECTANGULAR ? lonScale : 1) * scale;
+    double columnB = offsetColumn - originX * scale + BIAS;
+    for (size_t i = 0; i < n; i++)
+    {
+        columnOut[i] = static_cast<int32_t>(static_cast<int64_t>(lons[i] * columnA + columnB) - static_cast<int64_t>(BIAS));
+    }
+    if (type == EQUIRECTANGULAR)
+    {
+        double rowA = -scale;
+        double rowB = offsetRow - originY * scale + BIAS;
+        for (size_t i = 0; i < n; i++)
+        {
+            rowOut[i] = static_cast<int32_t>(static_cast<int64_t>(lats[i] * rowA + rowB) - static_cast<int64_t>(BIAS));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            rowOut[i] = static_cast<int32_t>(std::floor(row(lats[i])));
+        }
+    }
+}
@@ -0,0 +1,45 @@
+/**
+ * @brief Projection Class header
+ */
+#ifndef PROJECTION_H
+#define PROJECTION_H
+
+#include <cstdint>
+#include <vector>
+#include "graph.hpp"
+
+// Maps lat/lon coordinates inside a box onto a canvas of rows and columns,
+// north up, with the same scale on both axes so shapes keep their
+// proportions on any canvas. The box is centred on the canvas.
+class Projection {
+    public:
+        // EQUIRECTANGULAR scales longitude by the cosine of the middle
+        // latitude, which is accurate for city sized maps. WEB_MERCATOR
+        // matches the tiles of TileRenderer.
+        enum Type { EQUIRECTANGULAR, WEB_MERCATOR };
+
+    private:
+        Type type;
+        // Pixel = (projected - origin) * scale + offset, rows counted from the north
+        double originX, originY;
+        double scale;
+        double offsetRow, offsetColumn;
+        // Longitude scale of EQUIRECTANGULAR
+        double lonScale;
+
+        double projectX(double lon) const;
+        double projectY(double lat) const;
+
+    public:
+        Projection();
+        Projection(Type projectionType, double minLat, double minLon, double maxLat, double maxLon,
+                   unsigned rows, unsigned columns);
+        Type getType() const;
+        // Fractional pixel position of a coordinate
+        double row(double lat) const;
+        double column(double lon) const;
+        // Pixel position of every node of g, rounded down, indexed by graph index
+        void project(const Graph &g, std::vector<int32_t> &rows, std::vector<int32_t> &columns) const;
+};
+
+#endif
@@ -0,0 +1,223 @@
+/**
+ * @brief RouteCache Class implementation
+ */
+
+#include "routecache.hpp"
+#include "metrics.hpp"
+#include <atomic>
+#include <iterator>
+
+/** \brief  Mixes the four key fields into one hash. The top
+ *          bits choose the shard and the rest spread the keys
+ *          over the shard's buckets.
+ *
+ *          @return size_t
+*/
+size_t RouteCache::KeyHash::operator()(const Key &key) const
+{
+    uint64_t h = (static_cast<uint64_t>(key.src) << 32) | key.dest;
+    h ^= (static_cast<uint64_t>(key.profile) << 8 | key.mode) * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return static_cast<size_t>(h);
+}
+
+/** \brief  Constructor that splits capacity evenly over the
+ *          shards, rounding up.
+*/
+RouteCache::RouteCache(size_t capacity)
+        :shardCapacity((capacity + SHARDS - 1) / SHARDS), shards(new Shard[SHARDS])
+{
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        shards[s].hits = 0;
+        shards[s].misses = 0;
+    }
+}
+
+/** \brief  Public function that tells if the cache holds any
+ *          routes at all.
+ *
+ *          @return bool true unless constructed with capacity 0
+*/
+bool RouteCache::isEnabled() const
+{
+    return shardCapacity > 0;
+}
+
+/** \brief  Builds the key of a route query.
+ *
+ *          @return RouteCache::Key
+*/
+RouteCache::Key RouteCache::makeKey(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode)
+{
+    Key key;
+    key.src = src;
+    key.dest = dest;
+    key.profile = static_cast<uint8_t>(profile);
+    key.mode = static_cast<uint8_t>(mode);
+    return key;
+}
+
+/** \brief  Returns the shard that holds a key.
+ *
+ *          @return RouteCache::Shard &
+*/
+RouteCache::Shard &RouteCache::shardOf(const Key &key) const
+{
+    return shards[(static_cast<uint64_t>(KeyHash()(key)) >> 32) % SHARDS];
+}
+
+/** \brief  Public function that looks up the route from src to
+ *          dest found under profile and mode on the given
+ *          graph version. A hit moves the entry to the front
+ *          of its shard's LRU list. An entry found on another
+ *          version is erased, so it never answers again.
+ *
+ *          @return bool true on a hit
+*/
+bool RouteCache::find(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode, uint64_t version,
+                      Route &out)
+{
+    if (!isEnabled())
+    {
+        return false;
+    }
+    Key key = makeKey(src, dest, profile, mode);
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> hold(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end() && found->second->version != version)
+    {
+        shard.entries.erase(found->second);
+        shard.index.erase(found);
+        found = shard.index.end();
+    }
+    if (found == shard.index.end())
+    {
+        shard.misses++;
+        METRICS_COUNT(ROUTE_CACHE_MISSES, 1);
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    out = found->second->route;
+    out.settled = 0;
+    shard.hits++;
+    METRICS_COUNT(ROUTE_CACHE_HITS, 1);
+    return true;
+}
+
+/** \brief  Public function that stores the route from src to
+ *          dest found under profile and mode on the given
+ *          graph version, replacing any entry of the same key.
+ *          When the shard is full its least recently used
+ *          entry is evicted, and its list node is reused.
+ *
+ *          @return void
+*/
+void RouteCache::insert(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode, uint64_t version,
+                        const Route &route)
+{
+    if (!isEnabled())
+    {
+        return;
+    }
+    Key key = makeKey(src, dest, profile, mode);
+    Shard &shard = shardOf(key);
+    std::lock_guard<std::mutex> hold(shard.lock);
+    auto found = shard.index.find(key);
+    if (found != shard.index.end())
+    {
+        shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+    }
+    else if (shard.entries.size() >= shardCapacity)
+    {
+        shard.index.erase(shard.entries.back().key);
+        shard.entries.splice(shard.entries.begin(), shard.entries, std::prev(shard.entries.end()));
+        shard.index[key] = shard.entries.begin();
+    }
+    else
+    {
+        shard.entries.push_front(Entry());
+        shard.index[key] = shard.entries.begin();
+    }
+    Entry &entry = shard.entries.front();
+    entry.key = key;
+    entry.version = version;
+    entry.route = route;
+}
+
+/** \brief  Public function that drops every entry. The hit and
+ *          miss counts are kept.
+ *
+ *          @return void
+*/
+void RouteCache::clear()
+{
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        std::lock_guard<std::mutex> hold(shards[s].lock);
+        shards[s].entries.clear();
+        shards[s].index.clear();
+    }
+}
+
+/** \brief  Public function that returns the number of routes
+ *          held, including stale ones not yet looked up.
+ *
+ *          @return size_t
+*/
+size_t RouteCache::size() const
+{
+    size_t total = 0;
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        std::lock_guard<std::mutex> hold(shards[s].lock);
+        total += shards[s].entries.size();
+    }
+    return total;
+}
+
+/** \brief  Public function that returns the number of lookups
+ *          answered from the cache.
+ *
+ *          @return uint64_t
+*/
+uint64_t RouteCache::hits() const
+{
+    uint64_t total = 0;
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        std::lock_guard<std::mutex> hold(shards[s].lock);
+        total += shards[s].hits;
+    }
+    return total;
+}
+
+/** \brief  Public function that returns the number of lookups
+ *          that found no route of the current graph version.
+ *
+ *          @return uint64_t
+*/
+uint64_t RouteCache::misses() const
+{
+    uint64_t total = 0;
+    for (size_t s = 0; s < SHARDS; s++)
+    {
+        std::lock_guard<std::mutex> hold(shards[s].lock);
+        total += shards[s].misses;
+    }
+    return total;
+}
+
+/** \brief  Returns a graph version that has not been handed out
+ *          before in this process. Versions start at 1.
+ *
+ *          @return uint64_t
+*/
+uint64_t RouteCache::nextVersion()
+{
+    static std::atomic<uint64_t> last(0);
+    return ++last;
+}
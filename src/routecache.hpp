@@ -0,0 +1,78 @@
+/**
+ * @brief RouteCache Class header
+ */
+#ifndef ROUTECACHE_H
+#define ROUTECACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "profile.hpp"
+#include "router.hpp"
+
+// Bounded LRU cache of routes between graph indices, safe to use from
+// several threads. Keys are hashed to one of SHARDS shards, each with
+// its own lock and LRU list, so lookups of different keys rarely wait
+// on each other. Every entry carries the version of the graph it was
+// found on and only answers lookups for that version, so a reloaded or
+// updated graph never sees a stale route.
+class RouteCache {
+    private:
+        struct Key {
+            uint32_t src, dest;
+            uint8_t profile, mode;
+            bool operator==(const Key &other) const
+            {
+                return src == other.src && dest == other.dest && profile == other.profile && mode == other.mode;
+            }
+        };
+        struct KeyHash {
+            size_t operator()(const Key &key) const;
+        };
+        struct Entry {
+            Key key;
+            uint64_t version;
+            Route route;
+        };
+        struct Shard {
+            std::mutex lock;
+            // Most recently used first
+            std::list<Entry> entries;
+            std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index;
+            uint64_t hits, misses;
+        };
+
+        size_t shardCapacity;
+        std::unique_ptr<Shard[]> shards;
+
+        static Key makeKey(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode);
+        Shard &shardOf(const Key &key) const;
+
+    public:
+        static const size_t SHARDS = 16;
+
+        // Holds up to about capacity routes, 0 turns the cache off
+        explicit RouteCache(size_t capacity = 4096);
+        RouteCache(const RouteCache &) = delete;
+        RouteCache& operator=(const RouteCache &) = delete;
+        bool isEnabled() const;
+        // Copies the route found on graph version into out, with settled
+        // set to 0 since no search ran. Entries of other versions are dropped.
+        bool find(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode, uint64_t version,
+                  Route &out);
+        // Stores a route, evicting the least recently used one of its shard when full
+        void insert(uint32_t src, uint32_t dest, Profile::Type profile, Router::Mode mode, uint64_t version,
+                    const Route &route);
+        void clear();
+        size_t size() const;
+        // Lookups answered and not answered since construction
+        uint64_t hits() const;
+        uint64_t misses() const;
+        // Returns a version no graph has had yet, so every load or update can take a fresh one
+        static uint64_t nextVersion();
+};
+
+#endif
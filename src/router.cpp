@@ -0,0 +1,801 @@
+/**
+ * @brief Router Class implementation
+ */
+
+#include "router.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+    const double INF = std::numeric_limits<double>::infinity();
+    // heapPos values for nodes that are not in the heap
+    const uint32_t NOT_QUEUED = 0xffffffffu;
+    const uint32_t SETTLED = 0xfffffffeu;
+    // Arc lengths are stored as floats, so the heuristic is scaled
+    // down slightly to stay below any rounded path length.
+    const double HEURISTIC_SCALE = 0.9999;
+}
+
+/** \brief  Constructor for a router with no search state.
+ *          The per node arrays are sized on the first query.
+*/
+Router::Router()
+{
+}
+
+/** \brief  Returns the name of a search mode, as parseMode
+ *          reads it.
+ *
+ *          @return const char *
+*/
+const char *Router::modeName(Mode mode)
+{
+    switch (mode)
+    {
+        case BFS: return "bfs";
+        case DIJKSTRA: return "dijkstra";
+        case ASTAR: return "astar";
+        case BIDIRECTIONAL_BFS: return "bidirectional_bfs";
+        case BIDIRECTIONAL_DIJKSTRA: return "bidirectional_dijkstra";
+        case CONTRACTION_HIERARCHY: return "contraction_hierarchy";
+    }
+    return "";
+}
+
+/** \brief  Reads a search mode name.
+ *
+ *          @return bool false if text names no mode
+*/
+bool Router::parseMode(const char *text, Mode &mode)
+{
+    const Mode MODES[] = { BFS, DIJKSTRA, ASTAR, BIDIRECTIONAL_BFS, BIDIRECTIONAL_DIJKSTRA, CONTRACTION_HIERARCHY };
+    for (Mode m : MODES)
+    {
+        if (std::strcmp(text, modeName(m)) == 0)
+        {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** \brief  Finds a route from src to dest, both graph indices.
+ *          BFS returns the route with the fewest edges, while
+ *          DIJKSTRA and ASTAR return the cheapest route by the
+ *          arc weights of the graph's profile. ASTAR guides the
+ *          search with the straight-line distance to dest at
+ *          the profile's lowest cost per metre. Arcs the
+ *          profile may not use are never followed. The bidirectional
+ *          modes give the same routes as BFS and DIJKSTRA but
+ *          search from both ends until the two searches meet.
+ *          CONTRACTION_HIERARCHY needs a hierarchy, so given only
+ *          the graph it runs as BIDIRECTIONAL_DIJKSTRA.
+ *
+ *          @return Route
+*/
+Route Router::route(const Graph &g, uint32_t src, uint32_t dest, Mode mode)
+{
+    Route r;
+    if (src >= g.size() || dest >= g.size())
+    {
+        return r;
+    }
+    forward.reset(g.size());
+    switch (mode)
+    {
+        case BFS:
+            searchBfs(g, src, dest, r);
+            break;
+        case DIJKSTRA:
+        case ASTAR:
+            searchWeighted(g, src, dest, mode == ASTAR, r);
+            break;
+        case BIDIRECTIONAL_BFS:
+            backward.reset(g.size());
+            searchBidirectionalBfs(g, src, dest, r);
+            break;
+        case BIDIRECTIONAL_DIJKSTRA:
+        case CONTRACTION_HIERARCHY:
+            backward.reset(g.size());
+            searchBidirectionalDijkstra(g, src, dest, r);
+            break;
+    }
+    //Every node a search touches is queued exactly once
+    METRICS_COUNT(ROUTE_QUERIES, 1);
+    METRICS_COUNT(NODES_SETTLED, r.settled);
+    METRICS_COUNT(QUEUE_PUSHES, forward.touched.size() + (mode == BFS || mode == DIJKSTRA || mode == ASTAR
+                                                          ? 0 : backward.touched.size()));
+    return r;
+}
+
+/** \brief  Cheapest route query on a contraction hierarchy of
+ *          g. Both searches only follow arcs to higher ranked
+ *          nodes, the forward one along the arcs and the
+ *          backward one against them, and each stops once its smallest key is no
+ *          better than the best meeting found. Shortcuts on the
+ *          resulting path are unpacked into graph nodes; if one
+ *          cannot be, the route is left empty rather than wrong.
+ *
+ *          @return Route
+*/
+Route Router::route(const Graph &g, const ContractionHierarchy &ch, uint32_t src, uint32_t dest)
+{
+    Route r;
+    if (src >= ch.size() || dest >= ch.size())
+    {
+        return r;
+    }
+    forward.reset(ch.size());
+    backward.reset(ch.size());
+    forward.touched.push_back(src);
+    forward.parent[src] = src;
+    forward.dist[src] = 0;
+    forward.push(0, src);
+    backward.touched.push_back(dest);
+    backward.parent[dest] = dest;
+    backward.dist[dest] = 0;
+    backward.push(0, dest);
+    uint32_t meet = Graph::NO_NODE;
+    double best = INF;
+    while (true)
+    {
+        bool forwardOpen = !forward.heap.empty() && forward.heap[0].first < best;
+        bool backwardOpen = !backward.heap.empty() && backward.heap[0].first < best;
+        if (!forwardOpen && !backwardOpen)
+        {
+            break;
+        }
+        bool expandForward = forwardOpen && (!backwardOpen || forward.heap[0].first <= backward.heap[0].first);
+        SearchSpace &s = expandForward ? forward : backward;
+        SearchSpace &o = expandForward ? backward : forward;
+        uint32_t u = s.pop();
+        r.settled++;
+        double du = s.dist[u];
+        if (o.isReached(u) && du + o.dist[u] < best)
+        {
+            best = du + o.dist[u];
+            meet = u;
+        }
+        for (uint32_t e = ch.upBegin(u, !expandForward); e < ch.upEnd(u, !expandForward); e++)
+        {
+            uint32_t v = ch.upTarget(e, !expandForward);
+            double nd = du + ch.upWeight(e, !expandForward);
+            if (nd < s.dist[v])
+            {
+                if (!s.isReached(v))
+                {
+                    s.touched.push_back(v);
+                }
+                s.dist[v] = nd;
+                s.parent[v] = u;
+                if (s.heapPos[v] == NOT_QUEUED)
+                {
+                    s.push(nd, v);
+                }
+                else
+                {
+                    s.decrease(nd, v);
+                }
+            }
+        }
+    }
+    if (meet != Graph::NO_NODE)
+    {
+        std::vector<uint32_t> up;
+        unwind(src, meet, r);
+        up.swap(r.nodes);
+        for (uint32_t v = meet; v != dest; )
+        {
+            v = backward.parent[v];
+            up.push_back(v);
+        }
+        r.nodes.push_back(src);
+        bool unpacked = true;
+        for (size_t i = 1; i < up.size() && unpacked; i++)
+        {
+            unpacked = ch.unpackEdge(up[i - 1], up[i], r.nodes);
+        }
+        if (unpacked)
+        {
+            r.cost = best;
+            r.distance = pathLength(g, r.nodes);
+        }
+        else
+        {
+            r.nodes.clear();
+        }
+    }
+    METRICS_COUNT(ROUTE_QUERIES, 1);
+    METRICS_COUNT(NODES_SETTLED, r.settled);
+    METRICS_COUNT(QUEUE_PUSHES, forward.touched.size() + backward.touched.size());
+    return r;
+}
+
+/** \brief  Runs one Dijkstra search from src that stops once
+ *          every target has been settled, then writes the
+ *          distance to targets[i] into distances[i]. If paths is
+ *          not null it must hold targets.size() vectors, and
+ *          paths[i] receives the route to targets[i]. Targets
+ *          that cannot be reached get an infinite distance and
+ *          an empty path. Targets equal to Graph::NO_NODE count
+ *          as unreachable.
+ *
+ *          @return void
+*/
+void Router::oneToMany(const Graph &g, uint32_t src, const std::vector<uint32_t> &targets,
+                       double *distances, std::vector<uint32_t> *paths)
+{
+    std::fill(distances, distances + targets.size(), INF);
+    if (paths != nullptr)
+    {
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            paths[i].clear();
+        }
+    }
+    if (src >= g.size())
+    {
+        return;
+    }
+    forward.reset(g.size());
+    if (targetSlot.size() != g.size())
+    {
+        targetSlot.assign(g.size(), 0);
+    }
+    size_t remaining = 0;
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        if (targets[i] < g.size() && targetSlot[targets[i]] == 0)
+        {
+            targetSlot[targets[i]] = static_cast<uint32_t>(i + 1);
+            remaining++;
+        }
+    }
+    SearchSpace &f = forward;
+    f.touched.push_back(src);
+    f.dist[src] = 0;
+    f.parent[src] = src;
+    f.push(0, src);
+    while (!f.heap.empty() && remaining > 0)
+    {
+        uint32_t u = f.pop();
+        if (targetSlot[u] != 0)
+        {
+            remaining--;
+        }
+        double du = f.dist[u];
+        for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+        {
+            uint32_t v = g.arcTarget(a);
+            if (f.isSettled(v))
+            {
+                continue;
+            }
+            double nd = du + g.arcWeight(a);
+            if (nd < f.dist[v])
+            {
+                if (!f.isReached(v))
+                {
+                    f.touched.push_back(v);
+                }
+                f.dist[v] = nd;
+                f.parent[v] = u;
+                if (f.heapPos[v] == NOT_QUEUED)
+                {
+                    f.push(nd, v);
+                }
+                else
+                {
+                    f.decrease(nd, v);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        uint32_t t = targets[i];
+        if (t >= g.size())
+        {
+            continue;
+        }
+        targetSlot[t] = 0;
+        if (f.isSettled(t))
+        {
+            distances[i] = f.dist[t];
+            if (paths != nullptr)
+            {
+                Route r;
+                unwind(src, t, r);
+                paths[i].swap(r.nodes);
+            }
+        }
+    }
+}
+
+/** \brief  Settles every node that can be reached from src
+ *          at a cost of at most budget, cheapest first, and
+ *          stores them with their costs in out. Arcs that
+ *          would go over the budget are never queued, so the
+ *          search touches only the area inside the isochrone
+ *          and the arrays reused from earlier queries are
+ *          reset in time proportional to that area.
+ *
+ *          @return void
+*/
+void Router::reachable(const Graph &g, uint32_t src, double budget, Isochrone &out)
+{
+    out.source = src;
+    out.budget = budget;
+    out.nodes.clear();
+    out.costs.clear();
+    if (src >= g.size() || !(budget >= 0))
+    {
+        return;
+    }
+    forward.reset(g.size());
+    SearchSpace &f = forward;
+    f.touched.push_back(src);
+    f.dist[src] = 0;
+    f.parent[src] = src;
+    f.push(0, src);
+    while (!f.heap.empty())
+    {
+        uint32_t u = f.pop();
+        double du = f.dist[u];
+        out.nodes.push_back(u);
+        out.costs.push_back(du);
+        for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+        {
+            uint32_t v = g.arcTarget(a);
+            if (f.isSettled(v))
+            {
+                continue;
+            }
+            double nd = du + g.arcWeight(a);
+            if (nd <= budget && nd < f.dist[v])
+            {
+                if (!f.isReached(v))
+                {
+                    f.touched.push_back(v);
+                }
+                f.dist[v] = nd;
+                f.parent[v] = u;
+                if (f.heapPos[v] == NOT_QUEUED)
+                {
+                    f.push(nd, v);
+                }
+                else
+                {
+                    f.decrease(nd, v);
+                }
+            }
+        }
+    }
+}
+
+/** \brief  Breadth first search that keeps its queue in the
+ *          touched list, since nodes are touched in the order
+ *          they are discovered.
+ *
+ *          @return void
+*/
+void Router::searchBfs(const Graph &g, uint32_t src, uint32_t dest, Route &r)
+{
+    SearchSpace &f = forward;
+    f.touched.push_back(src);
+    f.parent[src] = src;
+    for (size_t head = 0; head < f.touched.size(); head++)
+    {
+        uint32_t u = f.touched[head];
+        r.settled++;
+        if (u == dest)
+        {
+            unwind(src, dest, r);
+            r.distance = pathLength(g, r.nodes);
+            r.cost = pathCost(g, r.nodes);
+            return;
+        }
+        for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+        {
+            uint32_t v = g.arcTarget(a);
+            if (!f.isReached(v) && g.arcWeight(a) != INF)
+            {
+                f.parent[v] = u;
+                f.touched.push_back(v);
+            }
+        }
+    }
+}
+
+/** \brief  Dijkstra's algorithm over arc weights, or A* when
+ *          useHeuristic is set. Each node is in the heap at
+ *          most once and its key is lowered in place.
+ *
+ *          @return void
+*/
+void Router::searchWeighted(const Graph &g, uint32_t src, uint32_t dest, bool useHeuristic, Route &r)
+{
+    SearchSpace &f = forward;
+    double destLat = g.getLat(dest), destLon = g.getLon(dest);
+    double heuristicScale = HEURISTIC_SCALE * g.getProfile().minCostPerMetre();
+    f.touched.push_back(src);
+    f.dist[src] = 0;
+    f.parent[src] = src;
+    f.push(0, src);
+    while (!f.heap.empty())
+    {
+        uint32_t u = f.pop();
+        r.settled++;
+        if (u == dest)
+        {
+            unwind(src, dest, r);
+            r.cost = f.dist[dest];
+            r.distance = pathLength(g, r.nodes);
+            return;
+        }
+        double du = f.dist[u];
+        for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+        {
+            uint32_t v = g.arcTarget(a);
+            if (f.isSettled(v))
+            {
+                continue;
+            }
+            double nd = du + g.arcWeight(a);
+            if (nd < f.dist[v])
+            {
+                if (!f.isReached(v))
+                {
+                    f.touched.push_back(v);
+                }
+                f.dist[v] = nd;
+                f.parent[v] = u;
+                double key = nd;
+                if (useHeuristic)
+                {
+                    key += heuristicScale * Graph::distance(g.getLat(v), g.getLon(v), destLat, destLon);
+                }
+                if (f.heapPos[v] == NOT_QUEUED)
+                {
+                    f.push(key, v);
+                }
+                else
+                {
+                    f.decrease(key, v);
+                }
+            }
+        }
+    }
+}
+
+/** \brief  Breadth first search from both ends. Whole levels
+ *          are expanded at a time, always on the side with the
+ *          smaller frontier, and the search stops after the
+ *          first level in which the two sides meet. The best
+ *          meeting node of that level gives the fewest edges.
+ *
+ *          @return void
+*/
+void Router::searchBidirectionalBfs(const Graph &g, uint32_t src, uint32_t dest, Route &r)
+{
+    forward.touched.push_back(src);
+    forward.parent[src] = src;
+    forward.dist[src] = 0;
+    backward.touched.push_back(dest);
+    backward.parent[dest] = dest;
+    backward.dist[dest] = 0;
+    uint32_t meet = (src == dest) ? src : Graph::NO_NODE;
+    double best = (src == dest) ? 0 : INF;
+    size_t headF = 0, headB = 0;
+    while (meet == Graph::NO_NODE && headF < forward.touched.size() && headB < backward.touched.size())
+    {
+        bool expandForward = forward.touched.size() - headF <= backward.touched.size() - headB;
+        SearchSpace &s = expandForward ? forward : backward;
+        SearchSpace &o = expandForward ? backward : forward;
+        size_t &head = expandForward ? headF : headB;
+        size_t levelEnd = s.touched.size();
+        for (; head < levelEnd; head++)
+        {
+            uint32_t u = s.touched[head];
+            r.settled++;
+            for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+            {
+                uint32_t v = g.arcTarget(a);
+                if (s.isReached(v) || (expandForward ? g.arcWeight(a) : g.arcReverseWeight(a)) == INF)
+                {
+                    continue;
+                }
+                s.parent[v] = u;
+                s.dist[v] = s.dist[u] + 1;
+                s.touched.push_back(v);
+                if (o.isReached(v) && s.dist[v] + o.dist[v] < best)
+                {
+                    best = s.dist[v] + o.dist[v];
+                    meet = v;
+                }
+            }
+        }
+    }
+    if (meet != Graph::NO_NODE)
+    {
+        unwindMeeting(src, meet, dest, r);
+        r.distance = pathLength(g, r.nodes);
+        r.cost = pathCost(g, r.nodes);
+    }
+}
+
+/** \brief  Dijkstra's algorithm from both ends. The side whose
+ *          smallest key is lower is advanced, every arc that
+ *          reaches a node seen by the other side updates the
+ *          best connection, and the search stops once the two
+ *          smallest keys together cannot improve on it.
+ *
+ *          @return void
+*/
+void Router::searchBidirectionalDijkstra(const Graph &g, uint32_t src, uint32_t dest, Route &r)
+{
+    forward.touched.push_back(src);
+    forward.parent[src] = src;
+    forward.dist[src] = 0;
+    forward.push(0, src);
+    backward.touched.push_back(dest);
+    backward.parent[dest] = dest;
+    backward.dist[dest] = 0;
+    backward.push(0, dest);
+    uint32_t meet = (src == dest) ? src : Graph::NO_NODE;
+    double best = (src == dest) ? 0 : INF;
+    while (!forward.heap.empty() && !backward.heap.empty())
+    {
+        if (forward.heap[0].first + backward.heap[0].first >= best)
+        {
+            break;
+        }
+        bool expandForward = forward.heap[0].first <= backward.heap[0].first;
+        SearchSpace &s = expandForward ? forward : backward;
+        SearchSpace &o = expandForward ? backward : forward;
+        uint32_t u = s.pop();
+        r.settled++;
+        double du = s.dist[u];
+        for (uint32_t a = g.arcBegin(u); a < g.arcEnd(u); a++)
+        {
+            uint32_t v = g.arcTarget(a);
+            if (s.isSettled(v))
+            {
+                continue;
+            }
+            double nd = du + (expandForward ? g.arcWeight(a) : g.arcReverseWeight(a));
+            if (nd < s.dist[v])
+            {
+                if (!s.isReached(v))
+                {
+                    s.touched.push_back(v);
+                }
+                s.dist[v] = nd;
+                s.parent[v] = u;
+                if (s.heapPos[v] == NOT_QUEUED)
+                {
+                    s.push(nd, v);
+                }
+                else
+                {
+                    s.decrease(nd, v);
+                }
+            }
+            if (o.isReached(v) && s.dist[v] + o.dist[v] < best)
+            {
+                best = s.dist[v] + o.dist[v];
+                meet = v;
+            }
+        }
+    }
+    if (meet != Graph::NO_NODE)
+    {
+        unwindMeeting(src, meet, dest, r);
+        r.cost = best;
+        r.distance = pathLength(g, r.nodes);
+    }
+}
+
+/** \brief  Follows parent links back from dest and stores the
+ *          path in r.nodes in source to destination order.
+ *
+ *          @return void
+*/
+void Router::unwind(uint32_t src, uint32_t dest, Route &r) const
+{
+    r.nodes.clear();
+    for (uint32_t v = dest; v != src; v = forward.parent[v])
+    {
+        r.nodes.push_back(v);
+    }
+    r.nodes.push_back(src);
+    std::reverse(r.nodes.begin(), r.nodes.end());
+}
+
+/** \brief  Joins the forward path from src to meet with the
+ *          backward path from meet to dest.
+ *
+ *          @return void
+*/
+void Router::unwindMeeting(uint32_t src, uint32_t meet, uint32_t dest, Route &r) const
+{
+    unwind(src, meet, r);
+    for (uint32_t v = meet; v != dest; )
+    {
+        v = backward.parent[v];
+        r.nodes.push_back(v);
+    }
+}
+
+/** \brief  Sums the great-circle lengths along a path.
+ *
+ *          @return double
+*/
+double Router::pathLength(const Graph &g, const std::vector<uint32_t> &nodes)
+{
+    double length = 0;
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+        length += Graph::distance(g.getLat(nodes[i - 1]), g.getLon(nodes[i - 1]),
+                                  g.getLat(nodes[i]), g.getLon(nodes[i]));
+    }
+    return length;
+}
+
+/** \brief  Sums the arc weights along a path, taking the
+ *          cheapest arc where two nodes are joined by several.
+ *
+ *          @return double
+*/
+double Router::pathCost(const Graph &g, const std::vector<uint32_t> &nodes)
+{
+    double cost = 0;
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+        double step = INF;
+        for (uint32_t a = g.arcBegin(nodes[i - 1]); a < g.arcEnd(nodes[i - 1]); a++)
+        {
+            if (g.arcTarget(a) == nodes[i] && g.arcWeight(a) < step)
+            {
+                step = g.arcWeight(a);
+            }
+        }
+        cost += step;
+    }
+    return cost;
+}
+
+/** \brief  Puts every node touched by the previous query back
+ *          to its initial state, so a query costs time in the
+ *          number of nodes it reached rather than the size of
+ *          the graph. The arrays are only reallocated when the
+ *          graph size changes.
+ *
+ *          @return void
+*/
+void Router::SearchSpace::reset(size_t n)
+{
+    if (dist.size() != n)
+    {
+        dist.assign(n, INF);
+        parent.assign(n, Graph::NO_NODE);
+        heapPos.assign(n, NOT_QUEUED);
+    }
+    else
+    {
+        for (uint32_t v : touched)
+        {
+            dist[v] = INF;
+            parent[v] = Graph::NO_NODE;
+            heapPos[v] = NOT_QUEUED;
+        }
+    }
+    touched.clear();
+    heap.clear();
+}
+
+/** \brief  Returns true once a node has been taken off the heap.
+ *
+ *          @return bool
+*/
+bool Router::SearchSpace::isSettled(uint32_t v) const
+{
+    return heapPos[v] == SETTLED;
+}
+
+/** \brief  Inserts a node into the heap.
+ *
+ *          @return void
+*/
+void Router::SearchSpace::push(double key, uint32_t v)
+{
+    heap.push_back(std::make_pair(key, v));
+    heapPos[v] = static_cast<uint32_t>(heap.size() - 1);
+    siftUp(heap.size() - 1);
+}
+
+/** \brief  Lowers the key of a node already in the heap.
+ *
+ *          @return void
+*/
+void Router::SearchSpace::decrease(double key, uint32_t v)
+{
+    size_t i = heapPos[v];
+    heap[i].first = key;
+    siftUp(i);
+}
+
+/** \brief  Removes the node with the smallest key from the
+ *          heap and marks it settled.
+ *
+ *          @return uint32_t
+*/
+uint32_t Router::SearchSpace::pop()
+{
+    uint32_t top = heap[0].second;
+    heapPos[top] = SETTLED;
+    heap[0] = heap.back();
+    heap.pop_back();
+    if (!heap.empty())
+    {
+        heapPos[heap[0].second] = 0;
+        siftDown(0);
+    }
+    return top;
+}
+
+/** \brief  Moves the entry at i up until its parent is smaller.
+ *
+ *          @return void
+*/
+void Router::SearchSpace::siftUp(size_t i)
+{
+    std::pair<double, uint32_t> item = heap[i];
+    while (i > 0)
+    {
+        size_t up = (i - 1) / 2;
+        if (heap[up].first <= item.first)
+        {
+            break;
+        }
+        heap[i] = heap[up];
+        heapPos[heap[i].second] = static_cast<uint32_t>(i);
+        i = up;
+    }
+    heap[i] = item;
+    heapPos[item.second] = static_cast<uint32_t>(i);
+}
+
+/** \brief  Moves the entry at i down until both children are larger.
+ *
+ *          @return void
+*/
+void Router::SearchSpace::siftDown(size_t i)
+{
+    std::pair<double, uint32_t> item = heap[i];
+    size_t n = heap.size();
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= n)
+        {
+            break;
+        }
+        if (child + 1 < n && heap[child + 1].first < heap[child].first)
+        {
+            child++;
+        }
+        if (item.first <= heap[child].first)
+        {
+            break;
+        }
+        heap[i] = heap[child];
+        heapPos[heap[i].second] = static_cast<uint32_t>(i);
+        i = child;
+    }
+    heap[i] = item;
+    heapPos[item.second] = static_cast<uint32_t>(i);
+}
@@ -0,0 +1,98 @@
+/**
+ * @brief Router Class header
+ */
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <cstdint>
+#include <vector>
+#include <utility>
+#include <limits>
+#include "graph.hpp"
+#include "hierarchy.hpp"
+
+// Result of a point to point query
+struct Route {
+    std::vector<uint32_t> nodes;    /** Graph indices from source to destination, empty if unreachable. */
+    double distance;                /** Total great-circle length in metres. */
+    double cost;                    /** Total arc weight under the graph's profile, infinity if unreachable. */
+    unsigned settled;               /** Nodes taken off the queue by the search. */
+    Route() : distance(0), cost(std::numeric_limits<double>::infinity()), settled(0) {}
+};
+
+// Distances, and optionally paths, between lists of origins and destinations
+struct DistanceMatrix {
+    size_t rows, columns;
+    std::vector<double> distances;              /** Row-major route costs under the graph's profile, infinity if unreachable. */
+    std::vector<std::vector<uint32_t>> paths;   /** Row-major graph index paths, empty unless requested. */
+    DistanceMatrix() : rows(0), columns(0) {}
+    double at(size_t row, size_t column) const { return distances[row * columns + column]; }
+};
+
+// Nodes reachable from a source within a cost budget
+struct Isochrone {
+    uint32_t source;                /** Graph index the search started from. */
+    double budget;                  /** Largest cost included, under the graph's profile. */
+    std::vector<uint32_t> nodes;    /** Graph indices in order of increasing cost, starting with source. */
+    std::vector<double> costs;      /** Cost of reaching nodes[i]. */
+    uint64_t version;               /** Map version searched, set by Osm, 0 if unknown. */
+    Isochrone() : source(Graph::NO_NODE), budget(0), version(0) {}
+};
+
+class Router {
+    public:
+        // Search strategies
+        enum Mode { BFS, DIJKSTRA, ASTAR, BIDIRECTIONAL_BFS, BIDIRECTIONAL_DIJKSTRA, CONTRACTION_HIERARCHY };
+
+    private:
+        // Search state of one direction, indexed by graph index
+        struct SearchSpace {
+            std::vector<double> dist;
+            std::vector<uint32_t> parent;
+            std::vector<uint32_t> heapPos;
+            // Nodes whose state differs from the reset values
+            std::vector<uint32_t> touched;
+            // Binary min-heap of (key, node)
+            std::vector<std::pair<double, uint32_t>> heap;
+
+            //Restores the state of every touched node and sizes the arrays for n nodes
+            void reset(size_t n);
+            void push(double key, uint32_t v);
+            void decrease(double key, uint32_t v);
+            uint32_t pop();
+            void siftUp(size_t i);
+            void siftDown(size_t i);
+            bool isSettled(uint32_t v) const;
+            bool isReached(uint32_t v) const { return parent[v] != Graph::NO_NODE; }
+        };
+        SearchSpace forward, backward;
+        // targetSlot[v] is the position of v in the current one-to-many
+        // target list plus one, or 0 if v is not a target
+        std::vector<uint32_t> targetSlot;
+
+        void searchBfs(const Graph &g, uint32_t src, uint32_t dest, Route &r);
+        void searchWeighted(const Graph &g, uint32_t src, uint32_t dest, bool useHeuristic, Route &r);
+        void searchBidirectionalBfs(const Graph &g, uint32_t src, uint32_t dest, Route &r);
+        void searchBidirectionalDijkstra(const Graph &g, uint32_t src, uint32_t dest, Route &r);
+        void unwind(uint32_t src, uint32_t dest, Route &r) const;
+        void unwindMeeting(uint32_t src, uint32_t meet, uint32_t dest, Route &r) const;
+        static double pathLength(const Graph &g, const std::vector<uint32_t> &nodes);
+        static double pathCost(const Graph &g, const std::vector<uint32_t> &nodes);
+
+    public:
+        Router();
+        static const char *modeName(Mode mode);
+        // Parses a mode name such as "astar", false for anything else
+        static bool parseMode(const char *text, Mode &mode);
+        // Finds a route between two graph indices
+        Route route(const Graph &g, uint32_t src, uint32_t dest, Mode mode = ASTAR);
+        // Finds a cheapest route using a contraction hierarchy of the graph
+        Route route(const Graph &g, const ContractionHierarchy &ch, uint32_t src, uint32_t dest);
+        // One Dijkstra search from src to every target; paths is filled only if not null
+        void oneToMany(const Graph &g, uint32_t src, const std::vector<uint32_t> &targets,
+                       double *distances, std::vector<uint32_t> *paths);
+        // Dijkstra search from src that stops once costs exceed budget
+        void reachable(const Graph &g, uint32_t src, double budget, Isochrone &out);
+};
+
+#endif
@@ -0,0 +1,690 @@
+/**
+ * @brief RouteServer Class implementation
+ */
+
+#include "routeserver.hpp"
+#include "image.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+    // How long run() sleeps in poll() between checks of stop()
+    const int IDLE_POLL_MS = 200;
+    // Largest canvas a render request may ask for
+    const unsigned MAX_RENDER_SIDE = 20000;
+
+    bool setNonBlocking(int fd)
+    {
+        int flags = ::fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    bool toDouble(const char *text, double &value)
+    {
+        char *end;
+        value = std::strtod(text, &end);
+        return end != text && *end == '\0';
+    }
+
+    bool toUnsigned(const char *text, unsigned long &value)
+    {
+        char *end;
+        value = std::strtoul(text, &end, 10);
+        return end != text && *end == '\0';
+    }
+
+    /** \brief  Splits line into words in place, ending each word
+     *          with a null where its separator was.
+     *
+     *          @return void
+    */
+    void splitWords(std::string &line, std::vector<char *> &words)
+    {
+        words.clear();
+        for (size_t i = 0; i < line.size(); i++)
+        {
+            char &ch = line[i];
+            if (ch == ' ' || ch == '\t')
+            {
+                ch = '\0';
+            }
+            else if (i == 0 || line[i - 1] == '\0')
+            {
+                words.push_back(&ch);
+            }
+        }
+    }
+
+    /** \brief  Tells if the first word of an unsplit line is
+     *          word.
+     *
+     *          @return bool
+    */
+    bool firstWordIs(const std::string &line, const char *word)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        size_t length = std::strlen(word);
+        return start != std::string::npos && line.compare(start, length, word) == 0 &&
+               (start + length == line.size() || line[start + length] == ' ' || line[start + length] == '\t');
+    }
+
+    /** \brief  Tells if name can be written inside the render
+     *          directory: a plain file name with no directory
+     *          part, not hidden and not . or ..
+     *
+     *          @return bool
+    */
+    bool isPlainFileName(const char *name)
+    {
+        return name[0] != '\0' && name[0] != '.' && std::strchr(name, '/') == nullptr && std::strlen(name) < NAME_MAX;
+    }
+
+    /** \brief  Appends printf style text to out without a
+     *          temporary string.
+     *
+     *          @return void
+    */
+    void appendf(std::string &out, const char *format, ...) __attribute__((format(printf, 2, 3)));
+    void appendf(std::string &out, const char *format, ...)
+    {
+        char text[64];
+        va_list args;
+        va_start(args, format);
+        int n = std::vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        if (n > 0)
+        {
+            out.append(text, std::min<size_t>(static_cast<size_t>(n), sizeof(text) - 1));
+        }
+    }
+}
+
+/** \brief  Constructor that starts the worker pool and builds
+ *          the spatial index of osm if it has none yet. The
+ *          contraction hierarchy is used if osm has one built
+ *          or loaded; without it contraction_hierarchy requests
+ *          run as bidirectional_dijkstra.
+*/
+RouteServer::RouteServer(Osm &server, unsigned threads)
+        :osm(server), listenFd(-1), pool(threads), batchSize(0), stopping(false)
+{
+    osm.buildSpatialIndex();
+    workers.resize(pool.size());
+}
+
+/** \brief  Destructor that closes every connection and
+ *          removes the socket file.
+*/
+RouteServer::~RouteServer()
+{
+    for (Client &client : clients)
+    {
+        ::close(client.fd);
+    }
+    if (listenFd >= 0)
+    {
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+    }
+}
+
+/** \brief  Public function that lets render requests write
+ *          their images into dir. Until it is called they are
+ *          refused, so clients cannot write files at all.
+ *
+ *          @return void
+*/
+void RouteServer::setRenderDirectory(const std::string &dir)
+{
+    renderDirectory = dir;
+}
+
+/** \brief  Creates the listening Unix domain socket at path.
+ *          A file already at path, such as the socket of a
+ *          server that was killed, is removed first.
+ *
+ *          @return bool false if the socket could not be bound
+*/
+bool RouteServer::listen(const std::string &path)
+{
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0 ||
+        ::listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd))
+    {
+        ::close(fd);
+        return false;
+    }
+    listenFd = fd;
+    socketPath = path;
+    return true;
+}
+
+/** \brief  Stops run() within IDLE_POLL_MS, after the batch
+ *          in progress is answered.
+ *
+ *          @return void
+*/
+void RouteServer::stop()
+{
+    stopping = true;
+}
+
+/** \brief  Serves requests until stop() is called. Once a
+ *          request arrives the server keeps collecting for
+ *          BATCH_WINDOW_MS at a time, as long as more keep
+ *          coming, up to MAX_BATCH requests, and then answers
+ *          them all at once on the pool.
+ *
+ *          @return void
+*/
+void RouteServer::run()
+{
+    while (!stopping && listenFd >= 0)
+    {
+        //Lines left over from a full batch are answered without waiting
+        for (size_t c = 0; c < clients.size() && batchSize < MAX_BATCH; c++)
+        {
+            if (!isBackedUp(clients[c]))
+            {
+                queueLines(c);
+            }
+        }
+        bool arrived = pollOnce(batchSize > 0 ? 0 : IDLE_POLL_MS);
+        while (arrived && batchSize < MAX_BATCH)
+        {
+            arrived = pollOnce(BATCH_WINDOW_MS);
+        }
+        if (batchSize > 0)
+        {
+            runBatch();
+        }
+        dropClosedClients();
+    }
+}
+
+/** \brief  Tells whether a client has more unsent answers
+ *          than MAX_PENDING_OUTPUT, in which case its requests
+ *          wait until it reads some of them.
+ *
+ *          @return bool
+*/
+bool RouteServer::isBackedUp(const Client &client)
+{
+    return client.output.size() - client.sent > MAX_PENDING_OUTPUT;
+}
+
+/** \brief  Tells whether a client should be read from: it is
+ *          open, not backed up, and has no complete request
+ *          left over from a full batch.
+ *
+ *          @return bool
+*/
+bool RouteServer::wantsInput(const Client &client)
+{
+    return !client.closing && !isBackedUp(client) && client.input.find('\n') == std::string::npos;
+}
+
+/** \brief  Waits up to timeoutMs for the sockets, then
+ *          accepts new clients, reads requests and sends
+ *          pending responses on the ones that are ready. Only
+ *          clients that want input are polled for it.
+ *
+ *          @return bool true if a request was queued
+*/
+bool RouteServer::pollOnce(int timeoutMs)
+{
+    polls.resize(clients.size() + 1);
+    polls[0].fd = listenFd;
+    polls[0].events = POLLIN;
+    for (size_t c = 0; c < clients.size(); c++)
+    {
+        polls[c + 1].fd = clients[c].fd;
+        polls[c + 1].events = static_cast<short>((wantsInput(clients[c]) ? POLLIN : 0) |
+                                                 (clients[c].output.size() > clients[c].sent ? POLLOUT : 0));
+    }
+    if (::poll(polls.data(), polls.size(), timeoutMs) <= 0)
+    {
+        return false;
+    }
+    size_t queued = batchSize;
+    size_t polled = clients.size();
+    for (size_t c = 0; c < polled; c++)
+    {
+        short ready = polls[c + 1].revents;
+        if (ready & (POLLERR | POLLNVAL))
+        {
+            clients[c].closing = true;
+            clients[c].input.clear();
+            clients[c].output.clear();
+            clients[c].sent = 0;
+            continue;
+        }
+        if ((ready & (POLLIN | POLLHUP)) && wantsInput(clients[c]) && readClient(c))
+        {
+            queueLines(c);
+        }
+        if (ready & POLLOUT)
+        {
+            flushClient(clients[c]);
+        }
+    }
+    if (polls[0].revents & POLLIN)
+    {
+        acceptClients();
+    }
+    return batchSize > queued;
+}
+
+/** \brief  Accepts every pending connection.
+ *
+ *          @return void
+*/
+void RouteServer::acceptClients()
+{
+    for (;;)
+    {
+        int fd = ::accept(listenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            return;
+        }
+        if (!setNonBlocking(fd))
+        {
+            ::close(fd);
+            continue;
+        }
+        Client client;
+        client.fd = fd;
+        client.sent = 0;
+        client.closing = false;
+        clients.push_back(client);
+    }
+}
+
+/** \brief  Reads what the client has sent, stopping at the
+ *          first chunk that completes a request or takes the
+ *          input past MAX_LINE, so the rest stays in the socket
+ *          until the server wants more. The client is marked
+ *          closing once it has shut down its side, and is then
+ *          dropped after its answers are sent.
+ *
+ *          @return bool true if any bytes were read
+*/
+bool RouteServer::readClient(size_t c)
+{
+    Client &client = clients[c];
+    char chunk[4096];
+    bool any = false;
+    for (;;)
+    {
+        ssize_t n = ::read(client.fd, chunk, sizeof(chunk));
+        if (n > 0)
+        {
+            client.input.append(chunk, static_cast<size_t>(n));
+            any = true;
+            if (std::memchr(chunk, '\n', static_cast<size_t>(n)) != nullptr || client.input.size() > MAX_LINE)
+            {
+                return any;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+        {
+            client.closing = true;
+        }
+        return any;
+    }
+}
+
+/** \brief  Moves the complete lines of a client's input into
+ *          free batch slots, reusing their strings, until the
+ *          batch is full. A client whose line grows past
+ *          MAX_LINE without ending is disconnected.
+ *
+ *          @return void
+*/
+void RouteServer::queueLines(size_t c)
+{
+    Client &client = clients[c];
+    size_t start = 0;
+    while (batchSize < MAX_BATCH)
+    {
+        size_t end = client.input.find('\n', start);
+        if (end == std::string::npos)
+        {
+            break;
+        }
+        size_t length = end - start;
+        if (length > 0 && client.input[end - 1] == '\r')
+        {
+            length--;
+        }
+        if (batchSize == batch.size())
+        {
+            batch.push_back(Request());
+        }
+        batch[batchSize].client = c;
+        batch[batchSize].line.assign(client.input, start, length);
+        batchSize++;
+        start = end + 1;
+    }
+    client.input.erase(0, start);
+    if (client.input.size() > MAX_LINE && client.input.find('\n') == std::string::npos)
+    {
+        client.input.clear();
+        client.closing = true;
+    }
+}
+
+/** \brief  Answers the current batch on the pool from one
+ *          map snapshot, then adds the answers to their
+ *          clients' output in the order the requests arrived
+ *          and starts sending them. Render requests wait for
+ *          the rest of the batch and are then drawn one at a
+ *          time on this thread, so at most one canvas exists
+ *          and the pool is free to draw it.
+ *
+ *          @return void
+*/
+void RouteServer::runBatch()
+{
+    std::shared_ptr<const MapState> map = osm.snapshot();
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        batch[i].render = firstWordIs(batch[i].line, "render");
+    }
+    pool.parallelFor(batchSize, [&](unsigned worker, size_t i) {
+        if (!batch[i].render)
+        {
+            handle(batch[i], workers[worker], *map);
+        }
+    });
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        if (batch[i].render)
+        {
+            render(batch[i], workers[0], *map);
+        }
+    }
+    for (size_t i = 0; i < batchSize; i++)
+    {
+        std::string &output = clients[batch[i].client].output;
+        output.append(batch[i].response);
+        output.push_back('\n');
+    }
+    batchSize = 0;
+    for (Client &client : clients)
+    {
+        flushClient(client);
+    }
+}
+
+/** \brief  Sends as much pending output as the socket takes
+ *          without blocking. The buffer is cleared, keeping its
+ *          capacity, once everything has been sent.
+ *
+ *          @return bool false if the connection failed
+*/
+bool RouteServer::flushClient(Client &client)
+{
+    while (client.sent < client.output.size())
+    {
+        ssize_t n = ::send(client.fd, client.output.data() + client.sent, client.output.size() - client.sent,
+                           MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return true;
+            }
+            client.output.clear();
+            client.sent = 0;
+            client.closing = true;
+            return false;
+        }
+        client.sent += static_cast<size_t>(n);
+    }
+    client.output.clear();
+    client.sent = 0;
+    return true;
+}
+
+/** \brief  Closes and forgets the clients that are closing
+ *          and have no requests left to answer or answers left
+ *          to send.
+ *
+ *          @return void
+*/
+void RouteServer::dropClosedClients()
+{
+    size_t kept = 0;
+    for (size_t c = 0; c < clients.size(); c++)
+    {
+        if (clients[c].closing && clients[c].output.empty() && clients[c].input.find('\n') == std::string::npos)
+        {
+            ::close(clients[c].fd);
+            continue;
+        }
+        if (kept != c)
+        {
+            std::swap(clients[kept], clients[c]);
+        }
+        kept++;
+    }
+    clients.resize(kept);
+}
+
+/** \brief  Looks up the graph index of an OSM node id.
+ *
+ *          @return bool false if the id is not in the graph
+*/
+bool RouteServer::findNode(const MapState &map, const char *id, uint32_t &index) const
+{
+    char *end;
+    unsigned long long value = std::strtoull(id, &end, 10);
+    index = (end != id && *end == '\0') ? map.graph.indexOf(value) : Graph::NO_NODE;
+    return index != Graph::NO_NODE;
+}
+
+/** \brief  Appends the cost, length, settled count and node
+ *          ids of a route to out.
+ *
+ *          @return void
+*/
+void RouteServer::writeRoute(const MapState &map, const Route &r, std::string &out) const
+{
+    if (r.nodes.empty())
+    {
+        out.append("error no route");
+        return;
+    }
+    const Graph &g = map.graph;
+    appendf(out, "ok %.3f %.3f %u %zu", r.cost, r.distance, r.settled, r.nodes.size());
+    for (uint32_t node : r.nodes)
+    {
+        appendf(out, " %llu", static_cast<unsigned long long>(g.getID(node)));
+    }
+}
+
+/** \brief  Answers one request into its response string. The
+ *          line is split into words in place and every search
+ *          uses the worker's own Router, so workers share only
+ *          read-only map data. Render requests go to render().
+ *
+ *          @return void
+*/
+void RouteServer::handle(Request &request, Worker &worker, const MapState &map) const
+{
+    std::string &out = request.response;
+    out.clear();
+    std::vector<char *> &words = worker.words;
+    splitWords(request.line, words);
+    const Graph &g = map.graph;
+    if (words.empty())
+    {
+        out.append("error empty request");
+    }
+    else if (std::strcmp(words[0], "ping") == 0)
+    {
+        out.append("ok");
+    }
+    else if (std::strcmp(words[0], "metrics") == 0)
+    {
+        out.append("ok ");
+        out.append(Metrics::json());
+    }
+    else if (std::strcmp(words[0], "route") == 0 || std::strcmp(words[0], "routeid") == 0)
+    {
+        METRICS_PHASE(COMPUTE_ROUTE);
+        bool byId = std::strcmp(words[0], "routeid") == 0;
+        size_t modeWord = byId ? 3 : 5;
+        Router::Mode mode = Router::ASTAR;
+        uint32_t src = Graph::NO_NODE, dest = Graph::NO_NODE;
+        double srcLat, srcLon, destLat, destLon;
+        if (words.size() < modeWord || words.size() > modeWord + 1 ||
+            (words.size() > modeWord && !Router::parseMode(words[modeWord], mode)))
+        {
+            out.append("error usage: route <srcLat> <srcLon> <destLat> <destLon> [mode] | routeid <srcId> <destId> [mode]");
+            return;
+        }
+        if (byId)
+        {
+            if (!findNode(map, words[1], src) || !findNode(map, words[2], dest))
+            {
+                out.append("error unknown node id");
+                return;
+            }
+        }
+        else
+        {
+            if (!toDouble(words[1], srcLat) || !toDouble(words[2], srcLon) ||
+                !toDouble(words[3], destLat) || !toDouble(words[4], destLon))
+            {
+                out.append("error bad coordinate");
+                return;
+            }
+            src = map.spatialIndex.nearest(srcLat, srcLon);
+            dest = map.spatialIndex.nearest(destLat, destLon);
+        }
+        writeRoute(map, osm.cachedRoute(map, worker.router, src, dest, mode), out);
+    }
+    else if (std::strcmp(words[0], "nearest") == 0)
+    {
+        double lat, lon;
+        if (words.size() != 3 || !toDouble(words[1], lat) || !toDouble(words[2], lon))
+        {
+            out.append("error usage: nearest <lat> <lon>");
+            return;
+        }
+        uint32_t node = map.spatialIndex.nearest(lat, lon);
+        if (node == Graph::NO_NODE)
+        {
+            out.append("error no routable nodes");
+            return;
+        }
+        appendf(out, "ok %llu %.7f %.7f", static_cast<unsigned long long>(g.getID(node)),
+                g.getLat(node), g.getLon(node));
+    }
+    else
+    {
+        out.append("error unknown request ").append(words[0]);
+    }
+}
+
+/** \brief  Answers a render request: draws the map, and the
+ *          route if one is asked for, and writes the image to
+ *          the named file in the render directory. The file is
+ *          opened without following a symbolic link there. The
+ *          image draws on the pool, so this must not be called
+ *          from a pool worker.
+ *
+ *          @return void
+*/
+void RouteServer::render(Request &request, Worker &worker, const MapState &map)
+{
+    std::string &out = request.response;
+    out.clear();
+    std::vector<char *> &words = worker.words;
+    splitWords(request.line, words);
+    const Graph &g = map.graph;
+    unsigned long rows, columns;
+    uint32_t src, dest;
+    if ((words.size() != 4 && words.size() != 6) || !toUnsigned(words[2], rows) ||
+        !toUnsigned(words[3], columns) || rows == 0 || columns == 0 ||
+        rows > MAX_RENDER_SIDE || columns > MAX_RENDER_SIDE || rows * columns > MAX_RENDER_PIXELS)
+    {
+        out.append("error usage: render <name.pgm> <rows> <columns> [srcId destId]");
+        return;
+    }
+    if (renderDirectory.empty())
+    {
+        out.append("error render disabled");
+        return;
+    }
+    if (!isPlainFileName(words[1]))
+    {
+        out.append("error render name must be a plain file name");
+        return;
+    }
+    if (words.size() == 6 && (!findNode(map, words[4], src) || !findNode(map, words[5], dest)))
+    {
+        out.append("error unknown node id");
+        return;
+    }
+    Image img(map, static_cast<unsigned>(rows), static_cast<unsigned>(columns), Projection::EQUIRECTANGULAR, &pool);
+    if (words.size() == 6)
+    {
+        Route r = worker.router.route(g, src, dest);
+        std::vector<OsmNode> route;
+        for (uint32_t node : r.nodes)
+        {
+            route.push_back(OsmNode(std::to_string(g.getID(node)), g.getLat(node), g.getLon(node)));
+        }
+        img.drawRoute(route);
+    }
+    std::string path = renderDirectory + "/" + words[1];
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+    if (fd < 0)
+    {
+        out.append("error cannot open ").append(words[1]);
+        return;
+    }
+    bool written = img.writeImage(fd);
+    if (::close(fd) != 0 || !written)
+    {
+        out.append("error cannot write ").append(words[1]);
+        return;
+    }
+    out.append("ok ").append(words[1]);
+}
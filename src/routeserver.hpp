@@ -0,0 +1,122 @@
+/**
+ * @brief RouteServer Class header
+ */
+#ifndef ROUTESERVER_H
+#define ROUTESERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <poll.h>
+#include "osm.hpp"
+#include "router.hpp"
+#include "threadpool.hpp"
+
+// Answers requests for one loaded map over a Unix domain socket. Each
+// request is one line of space separated words and gets one line back,
+// "ok ..." or "error <reason>":
+//   ping
+//   route <srcLat> <srcLon> <destLat> <destLon> [mode]
+//   routeid <srcId> <destId> [mode]
+//       ok <cost> <metres> <settled> <count> <id>...
+//   nearest <lat> <lon>
+//       ok <id> <lat> <lon>
+//   render <name.pgm> <rows> <columns> [srcId destId]
+//       ok <name.pgm>
+//   metrics
+//       ok <counters and phase times as one line of JSON>
+// Requests that arrive together, from any clients, are answered as one
+// batch on the worker pool, and each client gets its answers in order.
+// Render requests are refused unless a render directory is set, and then
+// write only plain file names inside it. They are drawn after the rest of
+// their batch, one at a time, with the idle workers drawing each image.
+// Every batch reads one Osm::snapshot(), so another thread may call
+// Osm::applyChange while the server runs and batches move to the new
+// map version once it is in place, with its spatial index and, if the
+// map had one, its contraction hierarchy built before the swap.
+// A client is not read from while it has a complete request waiting or
+// more than MAX_PENDING_OUTPUT bytes of answers it has not taken, so a
+// client that pipelines without end or stops reading cannot make the
+// server buffer without bound.
+class RouteServer {
+    private:
+        // One connected client and its unparsed input and unsent output
+        struct Client {
+            int fd;
+            std::string input;
+            std::string output;
+            size_t sent;
+            bool closing;
+        };
+        // A request line and the client it came from
+        struct Request {
+            size_t client;
+            std::string line;
+            std::string response;
+            bool render;
+        };
+        // Search state and scratch space of one worker
+        struct Worker {
+            Router router;
+            std::vector<char *> words;
+        };
+
+        Osm &osm;
+        std::string socketPath;
+        // Where render requests write, empty to refuse them
+        std::string renderDirectory;
+        int listenFd;
+        ThreadPool pool;
+        std::vector<Worker> workers;
+        std::vector<Client> clients;
+        // Slots of the current batch. Slots and their strings are kept
+        // between batches, so their buffers are only grown, never freed.
+        std::vector<Request> batch;
+        size_t batchSize;
+        // poll() set: the listening socket, then one entry per client
+        std::vector<struct pollfd> polls;
+        std::atomic<bool> stopping;
+
+        static bool isBackedUp(const Client &client);
+        static bool wantsInput(const Client &client);
+        bool pollOnce(int timeoutMs);
+        void acceptClients();
+        bool readClient(size_t c);
+        void queueLines(size_t c);
+        void runBatch();
+        bool flushClient(Client &client);
+        void dropClosedClients();
+        void handle(Request &request, Worker &worker, const MapState &map) const;
+        void render(Request &request, Worker &worker, const MapState &map);
+        void writeRoute(const MapState &map, const Route &r, std::string &out) const;
+        bool findNode(const MapState &map, const char *id, uint32_t &index) const;
+
+    public:
+        // Most requests answered in one batch
+        static const size_t MAX_BATCH = 256;
+        // How long to wait for more requests once one has arrived
+        static const int BATCH_WINDOW_MS = 1;
+        // Longest request line accepted, longer ones close the connection
+        static const size_t MAX_LINE = 4096;
+        // Unsent answers a client may have before the server stops reading its requests
+        static const size_t MAX_PENDING_OUTPUT = size_t(4) << 20;
+        // Largest canvas, in pixels and bytes, a render request may ask for
+        static const size_t MAX_RENDER_PIXELS = size_t(64) << 20;
+
+        // Serves osm, which must have its spatial index built, on threads workers (0 = all cores)
+        RouteServer(Osm &osm, unsigned threads = 0);
+        ~RouteServer();
+        RouteServer(const RouteServer &) = delete;
+        RouteServer& operator=(const RouteServer &) = delete;
+        // Binds the socket, replacing a stale socket file, false on failure
+        bool listen(const std::string &path);
+        // Lets render requests write into dir, which must exist
+        void setRenderDirectory(const std::string &dir);
+        // Serves requests until stop() is called
+        void run();
+        // Safe to call from a signal handler or another thread
+        void stop();
+};
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * @brief route server program
+ * Loads a map, or a snapshot written by Osm::save, once and answers route,
+ * nearest-node and render requests on a Unix domain socket until it is
+ * interrupted. See routeserver.hpp for the request format. For example:
+ *   echo "routeid 5162977672 8062710380" | nc -U /tmp/osm.sock
+ */
+
+#include <iostream>
+#include <csignal>
+#include <cstdlib>
+#include "osm.hpp"
+#include "routeserver.hpp"
+
+namespace {
+    RouteServer *running = nullptr;
+
+    void onSignal(int)
+    {
+        if (running != nullptr)
+        {
+            running->stop();
+        }
+    }
+}
+
+// usage: serve [map.osm|map.osm.pbf|snapshot] [socket] [distance|car|bike|foot] [threads] [hierarchy]
+//              [render dir]
+int main(int argc, char **argv) {
+    std::string path = (argc > 1) ? argv[1] : "./tests/fsu.osm";
+    std::string socketPath = (argc > 2) ? argv[2] : "/tmp/osm.sock";
+    OsmLoadOptions options;
+    if (argc > 3 && !Profile::parse(argv[3], options.profile))
+    {
+        std::cerr << "unknown profile " << argv[3] << std::endl;
+        return 1;
+    }
+    unsigned threads = (argc > 4) ? std::strtoul(argv[4], nullptr, 10) : 0;
+    Osm osm(path, options);
+    osm.buildSpatialIndex();
+    //Contraction hierarchy queries need the hierarchy, loaded from a file or built now
+    if (argc > 5 && !osm.loadHierarchy(argv[5]))
+    {
+        osm.buildHierarchy();
+        osm.saveHierarchy(argv[5]);
+    }
+    RouteServer server(osm, threads);
+    //Render requests stay refused unless a directory is given for them
+    if (argc > 6)
+    {
+        server.setRenderDirectory(argv[6]);
+    }
+    if (!server.listen(socketPath))
+    {
+        std::cerr << "cannot listen on " << socketPath << std::endl;
+        return 1;
+    }
+    running = &server;
+    std::signal(SIGINT, onSignal);
+    std::signal(SIGTERM, onSignal);
+    std::cout << "serving " << path << " on " << socketPath << std::endl;
+    server.run();
+    running = nullptr;
+    return 0;
+}
@@ -0,0 +1,220 @@
+/**
+ * @brief SpatialIndex Class implementation
+ */
+
+#include "spatialindex.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    const double TO_RAD = 3.14159265358979323846 / 180.0;
+}
+
+/** \brief  Default constructor, the index is empty until
+ *          build() is called.
+*/
+SpatialIndex::SpatialIndex()
+        :built(false)
+{
+}
+
+/** \brief  Indexes every node of the graph that the profile
+ *          can start or end a route at, so coordinates are never
+ *          snapped to a node only reached by unusable arcs.
+ *          The tree is implicit in the order of the arrays, so
+ *          it needs no pointers and is built in O(n log n).
+ *
+ *          @return void
+*/
+void SpatialIndex::build(const Graph &g)
+{
+    nodes.clear();
+    for (uint32_t i = 0; i < g.size(); i++)
+    {
+        if (g.isRoutable(i))
+        {
+            nodes.push_back(i);
+        }
+    }
+    buildRange(g, 0, nodes.size(), 0);
+    lats.resize(nodes.size());
+    lons.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        lats[i] = g.getLat(nodes[i]);
+        lons[i] = g.getLon(nodes[i]);
+    }
+    built = true;
+}
+
+/** \brief  Moves the median of [first, last) on this depth's
+ *          axis to the middle, smaller ones before it and
+ *          larger ones after, then does the same for both
+ *          halves.
+ *
+ *          @return void
+*/
+void SpatialIndex::buildRange(const Graph &g, size_t first, size_t last, unsigned depth)
+{
+    if (last - first < 2)
+    {
+        return;
+    }
+    size_t mid = first + (last - first) / 2;
+    std::nth_element(nodes.begin() + first, nodes.begin() + mid, nodes.begin() + last,
+                     [&](uint32_t a, uint32_t b) {
+                         return (depth & 1) ? g.getLon(a) < g.getLon(b) : g.getLat(a) < g.getLat(b);
+                     });
+    buildRange(g, first, mid, depth + 1);
+    buildRange(g, mid + 1, last, depth + 1);
+}
+
+/** \brief  Returns true once build() has been called, even
+ *          if the graph had no routable nodes.
+ *
+ *          @return bool
+*/
+bool SpatialIndex::isBuilt() const
+{
+    return built;
+}
+
+/** \brief  Returns the number of indexed nodes.
+ *
+ *          @return size_t
+*/
+size_t SpatialIndex::size() const
+{
+    return nodes.size();
+}
+
+/** \brief  Returns the graph index of the indexed node
+ *          closest to the coordinate.
+ *
+ *          @return uint32_t Graph::NO_NODE if the index is empty
+*/
+uint32_t SpatialIndex::nearest(double lat, double lon) const
+{
+    std::vector<uint32_t> found = nearest(lat, lon, 1);
+    return found.empty() ? Graph::NO_NODE : found[0];
+}
+
+/** \brief  Returns up to k indexed nodes, closest first.
+ *          Distances are measured on a plane tangent at the
+ *          query point, with longitude scaled by the cosine of
+ *          its latitude, which orders nodes the same way as
+ *          great-circle distance at map scales.
+ *
+ *          @return std::vector<uint32_t>
+*/
+std::vector<uint32_t> SpatialIndex::nearest(double lat, double lon, size_t k) const
+{
+    std::vector<uint32_t> found;
+    if (k == 0 || nodes.empty())
+    {
+        return found;
+    }
+    //Max-heap of (squared distance, tree position) holding the k best so far
+    std::vector<std::pair<double, size_t>> best;
+    best.reserve(std::min(k, nodes.size()) + 1);
+    nearestRange(0, nodes.size(), 0, lat, lon, std::cos(lat * TO_RAD), k, best);
+    std::sort_heap(best.begin(), best.end());
+    found.reserve(best.size());
+    for (const std::pair<double, size_t> &entry : best)
+    {
+        found.push_back(nodes[entry.second]);
+    }
+    return found;
+}
+
+/** \brief  Checks the splitting node of [first, last), then
+ *          descends into the half holding the query first. The
+ *          other half is only visited if the splitting plane is
+ *          closer than the worst of the k best found so far.
+ *
+ *          @return void
+*/
+void SpatialIndex::nearestRange(size_t first, size_t last, unsigned depth, double lat, double lon,
+                                double lonScale, size_t k, std::vector<std::pair<double, size_t>> &best) const
+{
+    if (first >= last)
+    {
+        return;
+    }
+    size_t mid = first + (last - first) / 2;
+    double dLat = lat - lats[mid];
+    double dLon = (lon - lons[mid]) * lonScale;
+    double d2 = dLat * dLat + dLon * dLon;
+    if (best.size() < k)
+    {
+        best.push_back(std::make_pair(d2, mid));
+        std::push_heap(best.begin(), best.end());
+    }
+    else if (d2 < best.front().first)
+    {
+        std::pop_heap(best.begin(), best.end());
+        best.back() = std::make_pair(d2, mid);
+        std::push_heap(best.begin(), best.end());
+    }
+    double plane = (depth & 1) ? dLon : dLat;
+    if (plane < 0)
+    {
+        nearestRange(first, mid, depth + 1, lat, lon, lonScale, k, best);
+        if (best.size() < k || plane * plane < best.front().first)
+        {
+            nearestRange(mid + 1, last, depth + 1, lat, lon, lonScale, k, best);
+        }
+    }
+    else
+    {
+        nearestRange(mid + 1, last, depth + 1, lat, lon, lonScale, k, best);
+        if (best.size() < k || plane * plane < best.front().first)
+        {
+            nearestRange(first, mid, depth + 1, lat, lon, lonScale, k, best);
+        }
+    }
+}
+
+/** \brief  Returns the graph indices of every indexed node
+ *          inside the box, bounds included.
+ *
+ *          @return std::vector<uint32_t>
+*/
+std::vector<uint32_t> SpatialIndex::inBox(double minLat, double minLon, double maxLat, double maxLon) const
+{
+    std::vector<uint32_t> found;
+    boxRange(0, nodes.size(), 0, minLat, minLon, maxLat, maxLon, found);
+    return found;
+}
+
+/** \brief  Adds the splitting node of [first, last) if it is
+ *          in the box and descends into each half that the box
+ *          reaches.
+ *
+ *          @return void
+*/
+void SpatialIndex::boxRange(size_t first, size_t last, unsigned depth, double minLat, double minLon,
+                            double maxLat, double maxLon, std::vector<uint32_t> &out) const
+{
+    if (first >= last)
+    {
+        return;
+    }
+    size_t mid = first + (last - first) / 2;
+    double lat = lats[mid], lon = lons[mid];
+    if (lat >= minLat && lat <= maxLat && lon >= minLon && lon <= maxLon)
+    {
+        out.push_back(nodes[mid]);
+    }
+    double split = (depth & 1) ? lon : lat;
+    double low = (depth & 1) ? minLon : minLat;
+    double high = (depth & 1) ? maxLon : maxLat;
+    if (low <= split)
+    {
+        boxRange(first, mid, depth + 1, minLat, minLon, maxLat, maxLon, out);
+    }
+    if (high >= split)
+    {
+        boxRange(mid + 1, last, depth + 1, minLat, minLon, maxLat, maxLon, out);
+    }
+}
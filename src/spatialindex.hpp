@@ -0,0 +1,44 @@
+/**
+ * @brief SpatialIndex Class header
+ */
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include "graph.hpp"
+
+// Static k-d tree over the routable nodes of a graph, for snapping
+// coordinates to nodes and finding the nodes inside a lat/lon box
+class SpatialIndex {
+    private:
+        // Graph indices in tree order. The middle entry of every range
+        // splits it, by latitude at even depths and longitude at odd ones.
+        std::vector<uint32_t> nodes;
+        // Coordinates of nodes[i], kept alongside so queries stay in these arrays
+        std::vector<double> lats, lons;
+        bool built;
+
+        void buildRange(const Graph &g, size_t first, size_t last, unsigned depth);
+        void nearestRange(size_t first, size_t last, unsigned depth, double lat, double lon, double lonScale,
+                          size_t k, std::vector<std::pair<double, size_t>> &best) const;
+        void boxRange(size_t first, size_t last, unsigned depth, double minLat, double minLon,
+                      double maxLat, double maxLon, std::vector<uint32_t> &out) const;
+
+    public:
+        SpatialIndex();
+        // Indexes every node of g with an arc its profile may use
+        void build(const Graph &g);
+        bool isBuilt() const;
+        size_t size() const;
+        // Closest indexed node, or Graph::NO_NODE if the index is empty
+        uint32_t nearest(double lat, double lon) const;
+        // Up to k indexed nodes, closest first
+        std::vector<uint32_t> nearest(double lat, double lon, size_t k) const;
+        // Indexed nodes inside the box, bounds included, in no particular order
+        std::vector<uint32_t> inBox(double minLat, double minLon, double maxLat, double maxLon) const;
+};
+
+#endif
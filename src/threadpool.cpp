@@ -0,0 +1,112 @@
+/**
+ * @brief ThreadPool Class implementation
+ */
+
+#include "threadpool.hpp"
+
+/** \brief  Constructor that starts the given number of worker
+ *          threads, or one per hardware thread when threads
+ *          is 0.
+*/
+ThreadPool::ThreadPool(unsigned threads)
+        :job(nullptr), jobCount(0), nextIndex(0), running(0), generation(0), stopping(false)
+{
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+    for (unsigned i = 0; i < threads; i++)
+    {
+        workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+    }
+}
+
+/** \brief  Destructor that stops and joins every worker.
+*/
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+/** \brief  Returns the number of worker threads.
+ *
+ *          @return unsigned
+*/
+unsigned ThreadPool::size() const
+{
+    return static_cast<unsigned>(workers.size());
+}
+
+/** \brief  Runs fn(worker, i) for every i in [0, count). The
+ *          workers take indices one at a time from a shared
+ *          counter, so uneven items balance out, and worker is
+ *          the id of the thread running the item so callers can
+ *          keep per-worker state without locking. Calls from
+ *          several threads are run one after another.
+ *
+ *          @return void
+*/
+void ThreadPool::parallelFor(size_t count, const std::function<void(unsigned, size_t)> &fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> submit(submitLock);
+    std::unique_lock<std::mutex> guard(lock);
+    job = &fn;
+    jobCount = count;
+    nextIndex.store(0);
+    running = size();
+    generation++;
+    wake.notify_all();
+    finished.wait(guard, [this]() { return running == 0; });
+    job = nullptr;
+}
+
+/** \brief  Body of each worker thread: waits for a job, takes
+ *          indices until none are left, then reports back.
+ *
+ *          @return void
+*/
+void ThreadPool::workerLoop(unsigned id)
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        const std::function<void(unsigned, size_t)> *current;
+        size_t count;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen]() { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+            current = job;
+            count = jobCount;
+        }
+        for (size_t i = nextIndex.fetch_add(1); i < count; i = nextIndex.fetch_add(1))
+        {
+            (*current)(id, i);
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running--;
+        }
+        finished.notify_one();
+    }
+}
@@ -0,0 +1,43 @@
+/**
+ * @brief ThreadPool Class header
+ */
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    private:
+        std::vector<std::thread> workers;
+        // Held by parallelFor so only one job runs at a time
+        std::mutex submitLock;
+        std::mutex lock;
+        std::condition_variable wake, finished;
+        // Current job: fn(worker, i) for each i below jobCount
+        const std::function<void(unsigned, size_t)> *job;
+        size_t jobCount;
+        std::atomic<size_t> nextIndex;
+        unsigned running;
+        uint64_t generation;
+        bool stopping;
+
+        void workerLoop(unsigned id);
+
+    public:
+        ThreadPool(unsigned threads = 0);
+        ~ThreadPool();
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool& operator=(const ThreadPool &) = delete;
+        unsigned size() const;
+        // Calls fn(worker, i) for every i in [0, count) on the workers and waits for all of them
+        void parallelFor(size_t count, const std::function<void(unsigned, size_t)> &fn);
+};
+
+#endif
@@ -0,0 +1,436 @@
+/**
+ * @brief TileRenderer Class implementation
+ */
+
+#include "tilerenderer.hpp"
+#include "image.hpp"
+#include "threadpool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace {
+    const double PI = 3.14159265358979323846;
+    // Web Mercator is cut off at the latitudes that make the world square
+    const double MAX_MERCATOR_LAT = 85.0511287798;
+    const uint8_t ROADS = 180;
+    const int RADIUS = 2;
+    const char MAGIC[8] = { 'O', 'S', 'M', 'T', 'I', 'L', 'E', 'S' };
+    const uint32_t FORMAT_VERSION = 1;
+
+    struct ArchiveHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t tiles;
+        uint64_t indexOffset;
+    };
+
+    // One entry of the index at the end of an archive, sorted by zoom, x, y
+    struct ArchiveEntry {
+        uint32_t zoom, x, y, reserved;
+        uint64_t offset, length;
+    };
+
+    bool entryLess(const ArchiveEntry &a, const ArchiveEntry &b)
+    {
+        if (a.zoom != b.zoom)
+        {
+            return a.zoom < b.zoom;
+        }
+        return (a.x != b.x) ? a.x < b.x : a.y < b.y;
+    }
+
+    /** \brief  Fraction of the world width west of a longitude.
+     *
+     *          @return double in [0, 1]
+    */
+    double projectX(double lon)
+    {
+        return (lon + 180) / 360;
+    }
+
+    /** \brief  Fraction of the world height north of a latitude.
+     *
+     *          @return double in [0, 1]
+    */
+    double projectY(double lat)
+    {
+        lat = std::max(-MAX_MERCATOR_LAT, std::min(MAX_MERCATOR_LAT, lat)) * PI / 180;
+        return (1 - std::log(std::tan(lat) + 1 / std::cos(lat)) / PI) / 2;
+    }
+
+    /** \brief  Tile index holding a fraction of the world, with
+     *          the far edge folded into the last tile.
+     *
+     *          @return uint32_t
+    */
+    uint32_t tileIndex(double fraction, unsigned zoom)
+    {
+        double tiles = std::ldexp(1.0, static_cast<int>(zoom));
+        double index = std::floor(fraction * tiles);
+        return static_cast<uint32_t>(std::max(0.0, std::min(index, tiles - 1)));
+    }
+
+    /** \brief  Creates a directory, succeeding if it is
+     *          already there.
+     *
+     *          @return bool
+    */
+    bool makeDirectory(const std::string &path)
+    {
+        return ::mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+    }
+
+    bool writeAt(int fd, const void *data, size_t size, off_t offset)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t n = ::pwrite(fd, bytes, size, offset);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                return false;
+            }
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+
+    bool readAt(int fd, void *data, size_t size, off_t offset)
+    {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0)
+        {
+            ssize_t n = ::pread(fd, bytes, size, offset);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return false;
+            }
+            bytes += n;
+            size -= static_cast<size_t>(n);
+            offset += n;
+        }
+        return true;
+    }
+}
+
+/** \brief  Constructor that projects every node of the graph
+ *          once and lists its edges. The graph must outlive the
+ *          renderer.
+*/
+TileRenderer::TileRenderer(const Graph &g)
+        :graph(g)
+{
+    mercatorX.resize(g.size());
+    mercatorY.resize(g.size());
+    for (uint32_t u = 0; u < g.size(); u++)
+    {
+        mercatorX[u] = projectX(g.getLon(u));
+        mercatorY[u] = projectY(g.getLat(u));
+        for (uint32_t v : g.neighbors(u))
+        {
+            if (v >= u)
+            {
+                edges.push_back(std::make_pair(u, v));
+            }
+        }
+    }
+}
+
+/** \brief  Returns the column of the tile holding a longitude.
+ *
+ *          @return uint32_t
+*/
+uint32_t TileRenderer::tileX(double lon, unsigned zoom)
+{
+    return tileIndex(projectX(lon), zoom);
+}
+
+/** \brief  Returns the row of the tile holding a latitude.
+ *
+ *          @return uint32_t
+*/
+uint32_t TileRenderer::tileY(double lat, unsigned zoom)
+{
+    return tileIndex(projectY(lat), zoom);
+}
+
+/** \brief  Throws InvertedZoomRange if minZoom is above
+ *          maxZoom and InvalidZoom if maxZoom is above
+ *          MAX_ZOOM. Called before any file or directory is
+ *          created, so a bad range leaves nothing behind.
+ *
+ *          @return void
+*/
+void TileRenderer::checkZoomRange(unsigned minZoom, unsigned maxZoom)
+{
+    if (minZoom > maxZoom)
+    {
+        throw InvertedZoomRange();
+    }
+    if (maxZoom > MAX_ZOOM)
+    {
+        throw InvalidZoom();
+    }
+}
+
+/** \brief  Lists the tiles of one zoom level that a stroke
+ *          of some edge reaches, and for each of them the edges
+ *          to draw. Each edge walks the columns of tiles it
+ *          spans, and in each column only the rows its segment
+ *          covers within that column, so a long diagonal edge
+ *          is binned into the tiles along it and not into its
+ *          whole bounding box. The segment is grown by PAD
+ *          pixels on every side, which covers the brush and the
+ *          rounding of the endpoints to pixels, so a tile never
+ *          misses a stroke that crosses into it.
+ *
+ *          @return void
+*/
+void TileRenderer::binEdges(unsigned zoom, std::vector<TileKey> &tiles,
+                            std::vector<std::vector<uint32_t>> &tileEdges) const
+{
+    const double PAD = RADIUS + 1;
+    const double SIZE = TILE_SIZE;
+    const double worldSize = std::ldexp(SIZE, static_cast<int>(zoom));
+    const int lastTile = (1 << zoom) - 1;
+    std::unordered_map<uint64_t, uint32_t> slots;
+    tiles.clear();
+    tileEdges.clear();
+    for (uint32_t e = 0; e < edges.size(); e++)
+    {
+        uint32_t u = edges[e].first, v = edges[e].second;
+        //World pixel endpoints, west one first
+        double ax = mercatorX[u] * worldSize, ay = mercatorY[u] * worldSize;
+        double bx = mercatorX[v] * worldSize, by = mercatorY[v] * worldSize;
+        if (ax > bx)
+        {
+            std::swap(ax, bx);
+            std::swap(ay, by);
+        }
+        double slope = (bx > ax) ? (by - ay) / (bx - ax) : 0;
+        int x0 = std::max(static_cast<int>(std::floor((ax - PAD) / SIZE)), 0);
+        int x1 = std::min(static_cast<int>(std::floor((bx + PAD) / SIZE)), lastTile);
+        for (int x = x0; x <= x1; x++)
+        {
+            //Part of the segment within PAD of this column
+            double from = std::max(ax, x * SIZE - PAD);
+            double to = std::min(bx, (x + 1) * SIZE + PAD);
+            double yFrom = (bx > ax) ? ay + (from - ax) * slope : ay;
+            double yTo = (bx > ax) ? ay + (to - ax) * slope : by;
+            int y0 = std::max(static_cast<int>(std::floor((std::min(yFrom, yTo) - PAD) / SIZE)), 0);
+            int y1 = std::min(static_cast<int>(std::floor((std::max(yFrom, yTo) + PAD) / SIZE)), lastTile);
+            for (int y = y0; y <= y1; y++)
+            {
+                uint64_t id = (static_cast<uint64_t>(x) << 32) | static_cast<uint32_t>(y);
+                auto found = slots.insert(std::make_pair(id, static_cast<uint32_t>(tiles.size())));
+                if (found.second)
+                {
+                    TileKey key = { zoom, static_cast<uint32_t>(x), static_cast<uint32_t>(y) };
+                    tiles.push_back(key);
+                    tileEdges.push_back(std::vector<uint32_t>());
+                }
+                tileEdges[found.first->second].push_back(e);
+            }
+        }
+    }
+}
+
+/** \brief  Renders every tile that holds an edge, zoom level
+ *          by zoom level, and hands each one to store. Tiles of
+ *          a level are drawn in parallel, each worker reusing
+ *          one tile sized canvas. Node positions are turned
+ *          into integer world pixels once per level, so tiles
+ *          sharing an edge draw it on the same pixels and strokes
+ *          line up across tile borders.
+ *
+ *          @return size_t number of tiles store accepted
+*/
+size_t TileRenderer::render(unsigned minZoom, unsigned maxZoom, unsigned threads,
+                            const std::function<bool(const TileKey &, const Image &)> &store) const
+{
+    checkZoomRange(minZoom, maxZoom);
+    ThreadPool pool(threads);
+    std::vector<std::unique_ptr<Image>> canvases;
+    for (unsigned i = 0; i < pool.size(); i++)
+    {
+        canvases.push_back(std::unique_ptr<Image>(new Image(TILE_SIZE, TILE_SIZE)));
+    }
+    std::vector<int> pixelX(graph.size()), pixelY(graph.size());
+    std::vector<TileKey> tiles;
+    std::vector<std::vector<uint32_t>> tileEdges;
+    std::atomic<size_t> stored(0);
+    for (unsigned zoom = minZoom; zoom <= maxZoom; zoom++)
+    {
+        double worldSize = std::ldexp(static_cast<double>(TILE_SIZE), static_cast<int>(zoom));
+        for (uint32_t u = 0; u < graph.size(); u++)
+        {
+            pixelX[u] = static_cast<int>(std::floor(mercatorX[u] * worldSize));
+            pixelY[u] = static_cast<int>(std::floor(mercatorY[u] * worldSize));
+        }
+        binEdges(zoom, tiles, tileEdges);
+        pool.parallelFor(tiles.size(), [&](unsigned worker, size_t t) {
+            Image &canvas = *canvases[worker];
+            canvas.clear();
+            int originX = static_cast<int>(tiles[t].x * TILE_SIZE);
+            int originY = static_cast<int>(tiles[t].y * TILE_SIZE);
+            for (uint32_t e : tileEdges[t])
+            {
+                uint32_t u = edges[e].first, v = edges[e].second;
+                canvas.drawSegment(pixelY[u] - originY, pixelX[u] - originX,
+                                   pixelY[v] - originY, pixelX[v] - originX, RADIUS, ROADS);
+            }
+            //An edge that only passes within PAD of the tile leaves it blank
+            if (!canvas.isBlank() && store(tiles[t], canvas))
+            {
+                stored++;
+            }
+        });
+    }
+    return stored;
+}
+
+/** \brief  Public function that renders the tiles from
+ *          minZoom to maxZoom, both included, into the usual
+ *          z/x/y.pgm layout under dir. Tiles with no edges are
+ *          not written, a missing tile is blank.
+ *
+ *          @return size_t number of tiles written
+*/
+size_t TileRenderer::renderDirectory(const std::string &dir, unsigned minZoom, unsigned maxZoom,
+                                     unsigned threads) const
+{
+    checkZoomRange(minZoom, maxZoom);
+    if (!makeDirectory(dir))
+    {
+        return 0;
+    }
+    for (unsigned zoom = minZoom; zoom <= maxZoom; zoom++)
+    {
+        makeDirectory(dir + "/" + std::to_string(zoom));
+    }
+    return render(minZoom, maxZoom, threads, [&](const TileKey &key, const Image &tile) {
+        std::string column = dir + "/" + std::to_string(key.zoom) + "/" + std::to_string(key.x);
+        if (!makeDirectory(column))
+        {
+            return false;
+        }
+        int fd = ::open((column + "/" + std::to_string(key.y) + ".pgm").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        bool written = tile.writeImage(fd);
+        return ::close(fd) == 0 && written;
+    });
+}
+
+/** \brief  Public function that renders the same tiles as
+ *          renderDirectory into a single file: a header, the
+ *          PGM of every tile, and an index sorted by zoom, x
+ *          and y that readArchiveTile searches. Workers append
+ *          their tiles as they finish, one at a time.
+ *
+ *          @return size_t number of tiles written, 0 if the file could not be written
+*/
+size_t TileRenderer::renderArchive(const std::string &path, unsigned minZoom, unsigned maxZoom,
+                                   unsigned threads) const
+{
+    checkZoomRange(minZoom, maxZoom);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return 0;
+    }
+    std::mutex appendLock;
+    std::vector<ArchiveEntry> index;
+    bool failed = ::lseek(fd, sizeof(ArchiveHeader), SEEK_SET) < 0;
+    size_t count = render(minZoom, maxZoom, threads, [&](const TileKey &key, const Image &tile) {
+        std::lock_guard<std::mutex> hold(appendLock);
+        off_t start = ::lseek(fd, 0, SEEK_CUR);
+        if (failed || start < 0 || !tile.writeImage(fd))
+        {
+            failed = true;
+            return false;
+        }
+        ArchiveEntry entry = { key.zoom, key.x, key.y, 0, static_cast<uint64_t>(start),
+                               static_cast<uint64_t>(::lseek(fd, 0, SEEK_CUR) - start) };
+        index.push_back(entry);
+        return true;
+    });
+    std::sort(index.begin(), index.end(), entryLess);
+    ArchiveHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.tiles = static_cast<uint32_t>(index.size());
+    off_t indexOffset = ::lseek(fd, 0, SEEK_CUR);
+    header.indexOffset = static_cast<uint64_t>(indexOffset);
+    failed = failed || indexOffset < 0 ||
+             !writeAt(fd, index.data(), index.size() * sizeof(ArchiveEntry), indexOffset) ||
+             !writeAt(fd, &header, sizeof(header), 0);
+    if (::close(fd) != 0 || failed)
+    {
+        return 0;
+    }
+    return count;
+}
+
+/** \brief  Public function that looks a tile up in the index
+ *          of an archive written by renderArchive and reads its
+ *          PGM into pgm.
+ *
+ *          @return bool false if the archive is damaged or has no such tile
+*/
+bool TileRenderer::readArchiveTile(const std::string &path, unsigned zoom, uint32_t x, uint32_t y, std::string &pgm)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    ArchiveHeader header;
+    std::vector<ArchiveEntry> index;
+    struct stat info;
+    bool found = false;
+    //The index must lie between the header and the end of the file, and
+    //every tile between the header and the index
+    if (::fstat(fd, &info) == 0 && readAt(fd, &header, sizeof(header), 0) &&
+        std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == FORMAT_VERSION &&
+        header.indexOffset >= sizeof(header) && header.indexOffset <= static_cast<uint64_t>(info.st_size) &&
+        header.tiles <= (static_cast<uint64_t>(info.st_size) - header.indexOffset) / sizeof(ArchiveEntry))
+    {
+        index.resize(header.tiles);
+        if (readAt(fd, index.data(), index.size() * sizeof(ArchiveEntry), static_cast<off_t>(header.indexOffset)))
+        {
+            ArchiveEntry wanted = { zoom, x, y, 0, 0, 0 };
+            auto it = std::lower_bound(index.begin(), index.end(), wanted, entryLess);
+            if (it != index.end() && !entryLess(wanted, *it) && it->length > 0 &&
+                it->offset >= sizeof(header) && it->offset <= header.indexOffset &&
+                it->length <= header.indexOffset - it->offset)
+            {
+                pgm.resize(it->length);
+                found = readAt(fd, &pgm[0], pgm.size(), static_cast<off_t>(it->offset));
+            }
+        }
+    }
+    ::close(fd);
+    return found;
+}
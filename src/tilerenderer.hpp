@@ -0,0 +1,61 @@
+/**
+ * @brief TileRenderer Class header
+ */
+#ifndef TILERENDERER_H
+#define TILERENDERER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "graph.hpp"
+
+class Image;
+
+// Renders the edges of a graph as 256x256 Web Mercator tiles for a
+// range of zoom levels. Each tile draws only the edges binned into it,
+// so no canvas larger than a tile is ever allocated.
+class TileRenderer {
+    public:
+        static const unsigned TILE_SIZE = 256;
+        // Deepest zoom whose world pixel coordinates fit in an int
+        static const unsigned MAX_ZOOM = 22;
+        // Thrown when a zoom range outside [0, MAX_ZOOM] is requested
+        class InvalidZoom {};
+        // Thrown when the minimum zoom of a range is above its maximum
+        class InvertedZoomRange {};
+
+    private:
+        // Address of one tile in the pyramid
+        struct TileKey {
+            unsigned zoom;
+            uint32_t x, y;
+        };
+        const Graph &graph;
+        // Web Mercator position of every node, in [0, 1) of the world width
+        std::vector<double> mercatorX, mercatorY;
+        // Undirected edges as pairs of graph indices, each listed once
+        std::vector<std::pair<uint32_t, uint32_t>> edges;
+
+        // Throws unless minZoom..maxZoom is a valid range, before anything is written
+        static void checkZoomRange(unsigned minZoom, unsigned maxZoom);
+        void binEdges(unsigned zoom, std::vector<TileKey> &tiles,
+                      std::vector<std::vector<uint32_t>> &tileEdges) const;
+        size_t render(unsigned minZoom, unsigned maxZoom, unsigned threads,
+                      const std::function<bool(const TileKey &, const Image &)> &store) const;
+
+    public:
+        explicit TileRenderer(const Graph &g);
+        // Writes dir/z/x/y.pgm for every tile a road is drawn on, returns the tile count
+        size_t renderDirectory(const std::string &dir, unsigned minZoom, unsigned maxZoom, unsigned threads = 0) const;
+        // Writes the same tiles into one archive file, returns the tile count
+        size_t renderArchive(const std::string &path, unsigned minZoom, unsigned maxZoom, unsigned threads = 0) const;
+        // Reads the PGM of one tile back from an archive, false if it is not there
+        static bool readArchiveTile(const std::string &path, unsigned zoom, uint32_t x, uint32_t y, std::string &pgm);
+        // Tile column and row holding a coordinate at a zoom level
+        static uint32_t tileX(double lon, unsigned zoom);
+        static uint32_t tileY(double lat, unsigned zoom);
+};
+
+#endif